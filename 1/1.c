@@ -1,34 +1,54 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
+#include <libavutil/cpu.h>
 #include <libswscale/swscale.h>
 
-void
-save_frame(uint8_t *buf, int linesize, int width, int height, const char *path);
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/file_io.h"
+#include "../common/frame_export.h"
+#include "../common/media.h"
+#include "../common/pool.h"
+#include "../common/thumbnail.h"
 
 int
 main(int argc, char const *argv[]) {
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
+    FileIOOptions io_opts;
+    argc = file_io_parse_args(&io_opts, argc, argv);
+    ThumbnailOptions thumb_opts;
+    argc = thumbnail_parse_args(&thumb_opts, argc, argv);
+    if (thumb_opts.lowres) {
+        decoder_opts.lowres_width = thumb_opts.width;
+        decoder_opts.lowres_height = thumb_opts.height;
+    }
+    if (argc < 2) {
+        printf("Usage: %s <file> [ppm|png|jpg] [max frames, 0 for all]\n", argv[0]);
+        return -1;
+    }
     const char *filename = argv[1];
-    int ret;
-    AVFormatContext *fmt_ctx = NULL;
-
-    // 打开视频文件
-    // 套路代码，注意第一个参数是 fmt_ctx 的地址
-    // 因为是函数内部实际创建 AVFormatContext，并修改 fmt_ctx 的值
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
-    if (ret < 0) {
-        printf("Could not open file %s\n", filename);
+    int format = argc > 2 ? export_format_from_name(argv[2]) : EXPORT_PPM;
+    if (format < 0) {
+        printf("Unknown image format %s\n", argv[2]);
         return -1;
     }
+    int max_frames = argc > 3 ? atoi(argv[3]) : 10;
+    int ret;
 
-    // 获取 stream 信息，写入到 fmt_ctx 中
-    // nb_streams 表示 stream 的个数
-    // streams 数组保存所有的 stream 结构
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    // 打开视频文件，获取 stream 信息，找到视频流
+    // 按 --io 参数选择读文件的方式，其他流的 packet 解复用时就跳过
+    MediaSource source;
+    ret = media_source_open(&source, filename, &io_opts, &probe_opts, DEMUX_WANT_VIDEO, &startup);
     if (ret < 0) {
-        printf("Could not find stream info %s\n", filename);
         return -1;
     }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
 
     // 打印视频的详细信息
     // 第一个参数是文件的 AVFormatContext
@@ -36,120 +56,159 @@ main(int argc, char const *argv[]) {
     // 其他参数不用管，写 0
     av_dump_format(fmt_ctx, 0, filename, 0);
 
-    // 找到视频流
-    int video_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-        }
+    // 找到视频流的解码器，配置好多线程后打开
+    // codec context 包含流使用的解码器的全部信息
+    Decoder decoder = {0};
+    VideoConverter converter = {0};
+    FrameExporter *exporter = NULL;
+    FramePool frame_pool = {0};
+    // 保存解码出的 frame，是 yuv 格式的图片
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    if (frame == NULL || packet == NULL) {
+        ret = AVERROR(ENOMEM);
+        goto end;
     }
-
-    if (video_stream_index == -1) {
-        printf("Could not find video stream\n");
-        return -1;
+    ret = decoder_open(&decoder, fmt_ctx, source.video_index, &decoder_opts);
+    if (ret < 0) {
+        goto end;
     }
-
-    AVStream *video_stream = fmt_ctx->streams[video_stream_index];
-    // 找到视频流的解码器
-    AVCodec *codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    if (codec == NULL) {
-        printf("Unsupported codec\n");
-        return -1;
+    AVCodecContext *codec_ctx = decoder.codec_ctx;
+
+    // 转换 yuv -> rgb，同时缩放到缩略图大小，输出图片的内存从转换器的池里取
+    // 导出线程写完图片释放 frame 以后内存回到池里，给后面的图片用
+    enum AVPixelFormat out_pix_fmt = export_format_pix_fmt(format);
+    int out_width, out_height;
+    thumbnail_size(&thumb_opts, codec_ctx->width, codec_ctx->height, codec_ctx->sample_aspect_ratio, &out_width,
+                   &out_height);
+    ret = video_converter_init(&converter, out_width, out_height, out_pix_fmt, thumb_opts.flags);
+    if (ret < 0) {
+        printf("Could not create converter\n");
+        goto end;
     }
 
-    // codec context 包含流使用的解码器的全部信息
-    // 分配内存，初始化解码器默认值
-    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_ctx, video_stream->codecpar);
-
-    // 打开解码器
-    ret = avcodec_open2(codec_ctx, codec, NULL);
+    // 编码和写文件交给工作线程，解码循环不会因为压缩图片或者写磁盘而停下来
+    // 图片的 frame 从池里取，池里放得下排队的、工作线程手里的和正在转换的，导出过程中不再分配
+    int workers = av_cpu_count();
+    int queue_size = workers * 2;
+    ret = frame_pool_init(&frame_pool, queue_size + workers + 1);
     if (ret < 0) {
-        printf("Could not open codec\n");
-        return -1;
+        printf("Could not allocate frame pool\n");
+        goto end;
+    }
+    exporter = frame_exporter_create(format, workers, queue_size, &frame_pool);
+    if (exporter == NULL) {
+        printf("Could not create exporter\n");
+        ret = -1;
+        goto end;
     }
-
-    // 保存解码出的 frame，是 yuv 格式的图片
-    AVFrame *frame = av_frame_alloc();
-    // 用来保存 yuv -> rgb 图像
-    AVFrame *frame_rbg = av_frame_alloc();
-    AVPacket *packet = av_packet_alloc();
-    // 分配存放图片数据的内存，关联到 frame_rbg
-    int buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, codec_ctx->width, codec_ctx->height, 32);
-    uint8_t *buffer = av_malloc(sizeof(uint8_t) * buffer_size);
-    av_image_fill_arrays(frame_rbg->data, frame_rbg->linesize, buffer, AV_PIX_FMT_RGB24, codec_ctx->width,
-                         codec_ctx->height, 32);
-
-    // 转行 yuv -> rgb
-    struct SwsContext *sws_ctx =
-        sws_getContext(codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt, codec_ctx->width, codec_ctx->height,
-                       AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
 
     int frame_count = 0;
-    while (av_read_frame(fmt_ctx, packet) == 0) {
-        // 只要视频的包
-        if (packet->stream_index != video_stream_index) {
-            continue;
+    int done = 0;
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+    DemuxStats demux_stats;
+    demux_stats_init(&demux_stats);
+    while (!done) {
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，发送 NULL 让解码器把缓存的帧都吐出来
+            ret = decoder_send_packet(&decoder, NULL);
+        } else {
+            // 只要视频的包
+            demux_stats_packet(&demux_stats, packet, packet->stream_index == source.video_index);
+            if (packet->stream_index != source.video_index) {
+                av_packet_unref(packet);
+                continue;
+            }
+            // 解码视频帧，packet 的数据交给解码器，packet 继续用来读下一个
+            ret = decoder_send_packet(&decoder, packet);
         }
-
-        // 解码视频帧
-        ret = avcodec_send_packet(codec_ctx, packet);
         if (ret < 0) {
             printf("Error decoding\n");
-            return -1;
+            goto end;
         }
 
         // 一个包里可能有多个视频帧，都读出来保存图片
         while (1) {
-            ret = avcodec_receive_frame(codec_ctx, frame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            ret = decoder_receive_frame(&decoder, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = 0;
+                break;
+            } else if (ret == AVERROR_EOF) {
+                // 排空结束，解码器里的帧都取完了
+                ret = 0;
+                done = 1;
                 break;
             } else if (ret < 0) {
                 printf("Error decoding\n");
-                return -1;
+                goto end;
             }
 
+            decode_stats_frame(&decode_stats);
             frame_count += 1;
-            if (frame_count > 10) {
-                return 0;
+            if (max_frames > 0 && frame_count > max_frames) {
+                done = 1;
+                break;
             }
 
-            // todo: stride?
-            sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, codec_ctx->height,
-                      frame_rbg->data, frame_rbg->linesize);
-            char path[128];
-            sprintf(path, "frame_%d.ppm", frame_count);
-            // printf("w %d h %d, w %d h %d\n", codec_ctx->width, codec_ctx->height, frame->width, frame->height);
-            save_frame(frame_rbg->data[0], frame_rbg->linesize[0], codec_ctx->width, codec_ctx->height, path);
+            // 流中途改变分辨率时缩略图的大小跟着变
+            thumbnail_size(&thumb_opts, frame->width, frame->height, frame->sample_aspect_ratio, &out_width,
+                           &out_height);
+            if (out_width != converter.width || out_height != converter.height) {
+                video_converter_free(&converter);
+                ret = video_converter_init(&converter, out_width, out_height, out_pix_fmt, thumb_opts.flags);
+                if (ret < 0) {
+                    printf("Could not create converter\n");
+                    goto end;
+                }
+            }
 
-            // 释放 packet 内部数据，并把 packet 一些自动设为默认值
-            av_packet_unref(packet);
+            // 每张图片从池里取一个 frame，交给导出线程后由它放回池里
+            AVFrame *frame_out = frame_pool_get(&frame_pool);
+            ret = frame_out == NULL ? AVERROR(ENOMEM) : video_converter_convert(&converter, frame, frame_out);
+            if (ret < 0) {
+                printf("Could not convert frame\n");
+                frame_pool_put(&frame_pool, &frame_out);
+                goto end;
+            }
+            av_frame_unref(frame);
+
+            char path[128];
+            sprintf(path, "frame_%d.%s", frame_count, export_format_extension(format));
+            ret = frame_exporter_submit(exporter, frame_out, path);
+            if (ret < 0) {
+                printf("Could not submit %s\n", path);
+                goto end;
+            }
+            startup_timer_first_frame(&startup);
         }
     }
 
+    decode_stats_print(&decode_stats, "video");
+    decoder_print_stats(&decoder, "video");
+    demux_stats_print(&demux_stats, fmt_ctx);
+
+end:
+    // 等待所有图片写完，有图片编码或者写文件失败时也返回错误
+    if (exporter != NULL && frame_exporter_finish(exporter, 1) > 0 && ret >= 0) {
+        ret = -1;
+    }
+    if (frame_pool.pool.items != NULL) {
+        frame_pool_print_stats(&frame_pool, "frame");
+        frame_pool_destroy(&frame_pool);
+    }
+
     // 清理分配的资源
-    // 释放分配的 buffer
-    av_free(buffer);
+    video_converter_free(&converter);
     // 释放 freame，注意传入的是 AVFrame 指针的指针，调用后，外面的 AVFrame 会被设置为 NULL
-    av_frame_free(&frame_rbg);
     av_frame_free(&frame);
-    // 关闭解码器上下文
+    av_packet_free(&packet);
+    // 释放解码器上下文
     // 解码器是 ffmpeg 内部全局创建的，不需要管
-    avcodec_close(codec_ctx);
-    // 关闭打开的文件，注意传入的是 AVFormatContext 指针的指针
-    avformat_close_input(&fmt_ctx);
-    return 0;
-}
-
-void
-save_frame(uint8_t *buf, int linesize, int width, int height, const char *path) {
-    FILE *file = fopen(path, "wb");
-    fprintf(file, "P6\n%d %d\n255\n", width, height);
-    // printf("line size %d\n", frame->linesize[0]);
-    for (size_t i = 0; i < height; i++) {
-        fwrite(buf + i * linesize, 1, width * 3, file);
-    }
-
-    fclose(file);
+    decoder_close(&decoder);
+    file_io_print_stats(source.io);
+    // 关闭打开的文件
+    media_source_close(&source);
+    return ret < 0 ? -1 : 0;
 }
@@ -1,15 +1,20 @@
 #include <SDL2/SDL.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/media.h"
+#include "../common/sdl_video.h"
+
 SDL_Renderer *renderer;
 SDL_Window *window;
 SDL_Texture *texture;
 
 void
-init_sdl(int width, int height) {
+init_sdl(int width, int height, Uint32 texture_format) {
     int ret;
     ret = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
     if (ret != 0) {
@@ -20,32 +25,28 @@ init_sdl(int width, int height) {
                               SDL_WINDOW_ALLOW_HIGHDPI);
     renderer = SDL_CreateRenderer(window, -1,
                                   SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, width, height);
+    texture = SDL_CreateTexture(renderer, texture_format, SDL_TEXTUREACCESS_STREAMING, width, height);
 }
 
 int
 main(int argc, char const *argv[]) {
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
     const char *filename = argv[1];
     int ret;
-    AVFormatContext *fmt_ctx = NULL;
-
-    // 打开视频文件
-    // 套路代码，注意第一个参数是 fmt_ctx 的地址
-    // 因为是函数内部实际创建 AVFormatContext，并修改 fmt_ctx 的值
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
-    if (ret < 0) {
-        printf("Could not open file %s\n", filename);
-        return -1;
-    }
 
-    // 获取 stream 信息，写入到 fmt_ctx 中
-    // nb_streams 表示 stream 的个数
-    // streams 数组保存所有的 stream 结构
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    // 打开视频文件，获取 stream 信息，找到视频流
+    // 其他流的 packet 解复用时就跳过
+    MediaSource source;
+    ret = media_source_open(&source, filename, NULL, &probe_opts, DEMUX_WANT_VIDEO, &startup);
     if (ret < 0) {
-        printf("Could not find stream info %s\n", filename);
         return -1;
     }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
 
     // 打印视频的详细信息
     // 第一个参数是文件的 AVFormatContext
@@ -53,71 +54,62 @@ main(int argc, char const *argv[]) {
     // 其他参数不用管，写 0
     av_dump_format(fmt_ctx, 0, filename, 0);
 
-    // 找到视频流
-    int video_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-        }
-    }
-
-    if (video_stream_index == -1) {
-        printf("Could not find video stream\n");
-        return -1;
-    }
-
-    AVStream *video_stream = fmt_ctx->streams[video_stream_index];
-    // 找到视频流的解码器
-    AVCodec *codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    if (codec == NULL) {
-        printf("Unsupported codec\n");
-        return -1;
-    }
-
+    // 找到视频流的解码器，配置好多线程后打开
     // codec context 包含流使用的解码器的全部信息
-    // 分配内存，初始化解码器默认值
-    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_ctx, video_stream->codecpar);
-
-    // 打开解码器
-    ret = avcodec_open2(codec_ctx, codec, NULL);
+    Decoder decoder;
+    ret = decoder_open(&decoder, fmt_ctx, source.video_index, &decoder_opts);
     if (ret < 0) {
-        printf("Could not open codec\n");
+        media_source_close(&source);
         return -1;
     }
+    AVCodecContext *codec_ctx = decoder.codec_ctx;
+    AVStream *video_stream = decoder.stream;
 
     int width = codec_ctx->width;
     int height = codec_ctx->height;
-    init_sdl(width, height);
+    // 解码器输出 yuv420p / nv12 时纹理直接用这个格式，frame 不用转换就能上传
+    enum AVPixelFormat out_pix_fmt = sdl_upload_pix_fmt(codec_ctx->pix_fmt);
+    init_sdl(width, height, sdl_texture_format(out_pix_fmt));
 
     // 保存解码出的 frame，是 yuv 格式的图片
     AVFrame *frame = av_frame_alloc();
-    // 用来保存 yuv420p
+    // 上传到纹理的 frame，格式和大小相同时只是引用解码出的 frame
     AVFrame *frame_out = av_frame_alloc();
     AVPacket *packet = av_packet_alloc();
 
-    // 负责图像转换的功能
-    struct SwsContext *sws_ctx = sws_getContext(width, height, codec_ctx->pix_fmt, width, height, AV_PIX_FMT_YUV420P,
-                                                SWS_BILINEAR, NULL, NULL, NULL);
-    // 分配存放图片数据的内存，关联到 frame
-    int buffer_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, codec_ctx->width, codec_ctx->height, 32);
-    uint8_t *buffer = av_malloc(sizeof(uint8_t) * buffer_size);
-    av_image_fill_arrays(frame_out->data, frame_out->linesize, buffer, AV_PIX_FMT_YUV420P, codec_ctx->width,
-                         codec_ctx->height, 32);
+    // 负责图像转换的功能，格式或大小和纹理不同时才需要
+    // 上下文按每一帧的实际参数创建并缓存，流中途改变分辨率也能正确转换
+    // 格式和大小都相同时转换器只增加 frame 的引用，不拷贝
+    VideoConverter converter;
+    if (video_converter_init(&converter, width, height, out_pix_fmt, SWS_BILINEAR) < 0) {
+        printf("Could not create converter\n");
+        return -1;
+    }
 
     int frame_count = 0;
     int last_pts = 0;
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+    DemuxStats demux_stats;
+    demux_stats_init(&demux_stats);
 
     AVRational time_base = video_stream->time_base;
-    while (av_read_frame(fmt_ctx, packet) == 0) {
-        // 只要视频流
-        if (packet->stream_index != video_stream_index) {
-            continue;
+    int done = 0;
+    while (!done) {
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，发送 NULL 让解码器把缓存的帧都吐出来
+            ret = decoder_send_packet(&decoder, NULL);
+        } else {
+            // 只要视频流
+            demux_stats_packet(&demux_stats, packet, packet->stream_index == source.video_index);
+            if (packet->stream_index != source.video_index) {
+                av_packet_unref(packet);
+                continue;
+            }
+            // 把 packet 中的数据传给解码器进行解码，packet 继续用来读下一个
+            ret = decoder_send_packet(&decoder, packet);
         }
-
-        // 把 packet 中的数据传给解码器进行解码
-        ret = avcodec_send_packet(codec_ctx, packet);
         if (ret < 0) {
             printf("Error decoding\n");
             return -1;
@@ -125,8 +117,12 @@ main(int argc, char const *argv[]) {
 
         // packet 里可能有多个完整的 frame
         while (1) {
-            ret = avcodec_receive_frame(codec_ctx, frame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            ret = decoder_receive_frame(&decoder, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            } else if (ret == AVERROR_EOF) {
+                // 排空结束，解码器里的帧都取完了
+                done = 1;
                 break;
             } else if (ret < 0) {
                 printf("Error decoding\n");
@@ -134,19 +130,19 @@ main(int argc, char const *argv[]) {
             }
 
             frame_count += 1;
+            decode_stats_frame(&decode_stats);
 
-            sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, codec_ctx->height,
-                      frame_out->data, frame_out->linesize);
+            // 格式相同时直接上传解码出的 frame，省掉一次整帧的转换和拷贝
+            ret = video_converter_convert(&converter, frame, frame_out);
+            if (ret < 0) {
+                printf("Could not convert video frame\n");
+                return -1;
+            }
             double fps = av_q2d(video_stream->r_frame_rate);
             double sleep_time = 1 / fps;
             SDL_Delay(1000 * sleep_time);
-            SDL_Rect rect;
-            rect.x = 0;
-            rect.y = 0;
-            rect.w = width;
-            rect.h = height;
-            SDL_UpdateYUVTexture(texture, &rect, frame_out->data[0], frame_out->linesize[0], frame_out->data[1],
-                                 frame_out->linesize[1], frame_out->data[2], frame_out->linesize[2]);
+            sdl_upload_frame(texture, frame_out);
+            av_frame_unref(frame_out);
             // clear the current rendering target with the drawing color
             SDL_RenderClear(renderer);
 
@@ -160,13 +156,15 @@ main(int argc, char const *argv[]) {
 
             // update the screen with any rendering performed since the previous call
             SDL_RenderPresent(renderer);
-            // 释放 packet 内部数据，并把 packet 一些自动设为默认值
-            av_packet_unref(packet);
+            startup_timer_first_frame(&startup);
             // handle Ctrl + C event
             SDL_Event event;
             SDL_PollEvent(&event);
             switch (event.type) {
             case SDL_QUIT: {
+                decode_stats_print(&decode_stats, "video");
+                decoder_print_stats(&decoder, "video");
+                demux_stats_print(&demux_stats, fmt_ctx);
                 SDL_Quit();
                 exit(0);
             } break;
@@ -178,17 +176,21 @@ main(int argc, char const *argv[]) {
         }
     }
 
+    decode_stats_print(&decode_stats, "video");
+    decoder_print_stats(&decoder, "video");
+    demux_stats_print(&demux_stats, fmt_ctx);
+
     // 清理分配的资源
-    // 释放分配的 buffer
-    av_free(buffer);
+    video_converter_free(&converter);
     // 释放 freame，注意传入的是 AVFrame 指针的指针，调用后，外面的 AVFrame 会被设置为 NULL
     av_frame_free(&frame_out);
     av_frame_free(&frame);
-    // 关闭解码器上下文
+    av_packet_free(&packet);
+    // 释放解码器上下文
     // 解码器是 ffmpeg 内部全局创建的，不需要管
-    avcodec_close(codec_ctx);
-    // 关闭打开的文件，注意传入的是 AVFormatContext 指针的指针
-    avformat_close_input(&fmt_ctx);
+    decoder_close(&decoder);
+    // 关闭打开的文件
+    media_source_close(&source);
 
     // 清理 sdl 资源
     SDL_DestroyRenderer(renderer);
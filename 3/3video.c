@@ -1,40 +1,27 @@
 #include <SDL2/SDL.h>
-#include <fcntl.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
 #include <libswresample/swresample.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-char wav_buf[100 * 1024 * 1024];
+#include "../common/audio_ring.h"
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/media.h"
+#include "../common/wav_writer.h"
 
-void
-save_wave(const char *filename, const char *data, int size, int sample_rate, int channels, int bits_per_sample) {
-    int f = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRWXU);
-    write(f, "RIFF", 4);
-    int chunk_size = size + 36;
-    write(f, &chunk_size, 4);
-    write(f, "WAVE", 4);
-    // chunk1
-    write(f, "fmt ", 4);
-    int chunk1_size = 16;
-    write(f, &chunk1_size, 4);
-    int format = 1;
-    write(f, &format, 2);
-    write(f, &channels, 2);
-    write(f, &sample_rate, 4);
-    int byte_rate = sample_rate * bits_per_sample * channels / 8;
-    write(f, &byte_rate, 4);
-    int block_align = bits_per_sample * channels / 8;
-    write(f, &block_align, 2);
-    write(f, &bits_per_sample, 2);
-    // chunk2
-    write(f, "data ", 4);
-    write(f, &size, 4);
-    write(f, data, size);
-}
+// 音频缓冲区的延迟目标（毫秒）
+#define AUDIO_LATENCY_MS 200
+// 音频缓冲区除了延迟目标之外预留的空间，要放得下一帧转换后的音频
+#define AUDIO_MAX_CHUNK (1024 * 1024)
+
+// 解码循环写入，SDL 音频回调读出
+AudioRing audio_ring;
 
 void
 init_sdl() {
@@ -46,6 +33,12 @@ init_sdl() {
     }
 }
 
+// SDL 在自己的音频线程里调用，需要多少数据就从缓冲区取多少，不够的部分补静音
+void
+audio_callback(void *userdata, Uint8 *stream, int len) {
+    audio_ring_fill(userdata, stream, len);
+}
+
 SDL_AudioDeviceID
 open_audio_device(int freq, int channels) {
     SDL_AudioSpec wav_spec;
@@ -53,12 +46,12 @@ open_audio_device(int freq, int channels) {
     wav_spec.format = AUDIO_F32;
     wav_spec.channels = channels;
     wav_spec.samples = 4096;
-    // 使用 SDL_QueueAudio，需要把这俩设置为 NULL
-    wav_spec.callback = NULL;
-    wav_spec.userdata = NULL;
+    // 设备需要数据时调用回调，从 audio_ring 里取
+    wav_spec.callback = audio_callback;
+    wav_spec.userdata = &audio_ring;
 
     SDL_AudioDeviceID device_id = SDL_OpenAudioDevice(NULL, 0, &wav_spec, NULL, SDL_AUDIO_ALLOW_ANY_CHANGE);
-    if (device_id < 0) {
+    if (device_id == 0) {
         fprintf(stderr, "Couldn't open audio: %s\n", SDL_GetError());
         exit(-1);
     }
@@ -70,27 +63,24 @@ open_audio_device(int freq, int channels) {
 
 int
 main(int argc, char const *argv[]) {
-    const char *filename = "video.mp4";
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
+    const char *filename = argc > 1 ? argv[1] : "video.mp4";
+    const char *wav_filename = argc > 2 ? argv[2] : "sound1.wav";
     int ret;
-    AVFormatContext *fmt_ctx = NULL;
-
-    // 打开视频文件
-    // 套路代码，注意第一个参数是 fmt_ctx 的地址
-    // 因为是函数内部实际创建 AVFormatContext，并修改 fmt_ctx 的值
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
-    if (ret < 0) {
-        printf("Could not open file %s\n", filename);
-        return -1;
-    }
 
-    // 获取 stream 信息，写入到 fmt_ctx 中
-    // nb_streams 表示 stream 的个数
-    // streams 数组保存所有的 stream 结构
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    // 打开视频文件，获取 stream 信息，找到音频流
+    // 只要音频流，视频和字幕的 packet 解复用时就跳过
+    MediaSource source;
+    ret = media_source_open(&source, filename, NULL, &probe_opts, DEMUX_WANT_AUDIO, &startup);
     if (ret < 0) {
-        printf("Could not find stream info %s\n", filename);
         return -1;
     }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
 
     // 打印视频的详细信息
     // 第一个参数是文件的 AVFormatContext
@@ -98,97 +88,75 @@ main(int argc, char const *argv[]) {
     // 其他参数不用管，写 0
     av_dump_format(fmt_ctx, 0, filename, 0);
 
-    // 找到视频流
-    // int video_stream_index = -1;
-    // for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-    //     AVStream *s = fmt_ctx->streams[i];
-    //     if (s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-    //         video_stream_index = i;
-    //     }
-    // }
-    // if (video_stream_index == -1) {
-    //     printf("Could not find video stream\n");
-    //     return -1;
-    // }
-    // AVStream *video_stream = fmt_ctx->streams[video_stream_index];
-    // // 找到视频流的解码器
-    // AVCodec *video_codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    // if (video_codec == NULL) {
-    //     printf("Unsupported video codec\n");
-    //     return -1;
-    // }
-    // AVCodecContext *video_codec_ctx = avcodec_alloc_context3(video_codec);
-    // avcodec_parameters_to_context(video_codec_ctx, video_stream->codecpar);
-    // ret = avcodec_open2(video_codec_ctx, video_codec, NULL);
-    // if (ret < 0) {
-    //     printf("Could not open video codec\n");
-    //     return -1;
-    // }
-
-    // 找到音频流
-    int audio_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            audio_stream_index = i;
-        }
-    }
-    if (audio_stream_index == -1) {
-        printf("Could not find audio stream\n");
-        return -1;
-    }
-    AVStream *audio_stream = fmt_ctx->streams[audio_stream_index];
-    // 找到音频解码器
-    AVCodec *audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
-    if (audio_codec == NULL) {
-        printf("Unsupported audio codec\n");
-        return -1;
-    }
-    AVCodecContext *audio_codec_ctx = avcodec_alloc_context3(audio_codec);
-    avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
-    ret = avcodec_open2(audio_codec_ctx, audio_codec, NULL);
+    // 找到音频解码器并打开
+    Decoder decoder;
+    ret = decoder_open(&decoder, fmt_ctx, source.audio_index, &decoder_opts);
     if (ret < 0) {
-        printf("Could not open audio codec\n");
+        media_source_close(&source);
         return -1;
     }
+    AVCodecContext *audio_codec_ctx = decoder.codec_ctx;
+    int audio_stream_index = source.audio_index;
 
     int channels = audio_codec_ctx->channels;
     int sample_rate = audio_codec_ctx->sample_rate;
     int format = audio_codec_ctx->sample_fmt;
-    int layout = audio_codec_ctx->channel_layout;
+    // 有些解码器不填声道布局，按声道数取默认布局
+    uint64_t layout = audio_codec_ctx->channel_layout;
+    if (layout == 0) {
+        layout = av_get_default_channel_layout(channels);
+    }
     printf("channels: %d, saple_rate: %d, format: %d\n", channels, sample_rate, format);
 
-    // 重采样转换音频格式
-    SwrContext *swr_ctx = swr_alloc_set_opts(NULL,              // we're allocating a new context
-                                             layout,            // out_ch_layout
-                                             AV_SAMPLE_FMT_FLT, // out_sample_fmt
-                                             sample_rate,       // out_sample_rate
-                                             layout,            // in_ch_layout
-                                             format,            // in_sample_fmt
-                                             sample_rate,       // in_sample_rate
-                                             0,                 // log_offset
-                                             NULL);             // log_ctx
+    // 转换成交错的 float，上下文按每一帧的实际参数创建并缓存
+    // 采样率和声道不变时（比如 aac 解码出的 fltp）只是交错，直接用 SIMD 转换，不经过 swresample
+    AudioConverter converter;
+    audio_converter_init(&converter, layout, AV_SAMPLE_FMT_FLT, sample_rate);
+    // 缓冲区准备好以后再打开设备，回调一开始就能安全地读
+    int bytes_per_second = sample_rate * channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_FLT);
+    if (audio_ring_init(&audio_ring, bytes_per_second * AUDIO_LATENCY_MS / 1000, AUDIO_MAX_CHUNK) < 0) {
+        printf("Could not allocate audio buffer\n");
+        return -1;
+    }
     // 初始化 sdl 音频
     init_sdl();
     SDL_AudioDeviceID device_id = open_audio_device(sample_rate, channels);
 
     AVFrame *frame = av_frame_alloc();
-    AVFrame *frame_resample = av_frame_alloc();
-    frame_resample->channel_layout = layout;
-    frame_resample->sample_rate = sample_rate;
-    frame_resample->channels = channels;
-    frame_resample->format = AV_SAMPLE_FMT_FLT;
+    int sample_bytes = converter.channels * av_get_bytes_per_sample(converter.format);
+
+    // 解码出的音频边播放边写入 wav 文件
+    WavWriter wav;
+    ret = wav_writer_open(&wav, wav_filename, sample_rate, channels, 32, 1);
+    if (ret < 0) {
+        printf("Could not open %s\n", wav_filename);
+        return -1;
+    }
+
+    // 写 wav 出错时停止录制，只继续播放
+    int recording = 1;
 
     AVPacket *packet = av_packet_alloc();
-    int wav_length = 0;
-    while (av_read_frame(fmt_ctx, packet) == 0) {
-        // 只要音频
-        if (packet->stream_index != audio_stream_index) {
-            continue;
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+    DemuxStats demux_stats;
+    demux_stats_init(&demux_stats);
+    int done = 0;
+    while (!done) {
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，发送 NULL 让解码器把缓存的帧都吐出来
+            ret = decoder_send_packet(&decoder, NULL);
+        } else {
+            // 只要音频
+            demux_stats_packet(&demux_stats, packet, packet->stream_index == audio_stream_index);
+            if (packet->stream_index != audio_stream_index) {
+                av_packet_unref(packet);
+                continue;
+            }
+            // 把 packet 中的数据传给解码器进行解码，packet 继续用来读下一个
+            ret = decoder_send_packet(&decoder, packet);
         }
-
-        // 把 packet 中的数据传给解码器进行解码
-        ret = avcodec_send_packet(audio_codec_ctx, packet);
         if (ret < 0) {
             printf("Error decoding\n");
             return -1;
@@ -196,29 +164,42 @@ main(int argc, char const *argv[]) {
 
         // packet 里可能有多个完整的 frame
         while (1) {
-            ret = avcodec_receive_frame(audio_codec_ctx, frame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            ret = decoder_receive_frame(&decoder, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            } else if (ret == AVERROR_EOF) {
+                // 排空结束，解码器里的帧都取完了
+                done = 1;
                 break;
             } else if (ret < 0) {
                 printf("Error decoding\n");
                 return -1;
             }
 
-            // 转换音频格式
-            ret = swr_convert_frame(swr_ctx, frame_resample, frame);
+            decode_stats_frame(&decode_stats);
+
+            // 转换音频格式，结果在转换器的缓冲区里，下一帧转换前有效
+            uint8_t *data;
+            ret = audio_converter_convert_buffer(&converter, frame, &data);
             if (ret < 0) {
                 printf("Resample error\n");
                 return -1;
             }
 
-            int frame_size =
-                frame_resample->nb_samples * frame_resample->channels * av_get_bytes_per_sample(frame_resample->format);
+            int frame_size = ret * sample_bytes;
             printf("frame sample %d, %d\n", frame->linesize[0], frame_size);
-            memcpy(wav_buf + wav_length, frame_resample->data[0], frame_size);
-            wav_length += frame_size;
-            SDL_QueueAudio(device_id, frame_resample->data[0], frame_size);
-            // 释放 packet 内部数据，并把 packet 一些自动设为默认值
-            av_packet_unref(packet);
+            if (recording && wav_writer_write(&wav, data, frame_size) < 0) {
+                printf("Could not write %s, stop recording\n", wav_filename);
+                wav_writer_close(&wav);
+                recording = 0;
+            }
+            // 缓冲区里的数据达到延迟目标就等回调取走一些
+            if (audio_ring_wait(&audio_ring, frame_size, NULL) < 0) {
+                printf("Audio frame too large\n");
+                return -1;
+            }
+            audio_ring_write(&audio_ring, data, frame_size);
+            startup_timer_first_frame(&startup);
 
             // handle event
             SDL_Event event;
@@ -226,6 +207,13 @@ main(int argc, char const *argv[]) {
             switch (event.type) {
             case SDL_QUIT: {
                 printf("quit event\n");
+                if (recording) {
+                    wav_writer_close(&wav);
+                }
+                decode_stats_print(&decode_stats, "audio");
+                decoder_print_stats(&decoder, "audio");
+                demux_stats_print(&demux_stats, fmt_ctx);
+                audio_ring_print_stats(&audio_ring);
                 SDL_Quit();
                 exit(0);
             } break;
@@ -236,19 +224,43 @@ main(int argc, char const *argv[]) {
             }
         }
     }
-    // printf("wav length: %d\n", wav_length);
-    // save_wave("sound1.wav", wav_buf, wav_length, sample_rate, channels, 32);
-    // 等待队列的音频播放完
-    while (SDL_GetQueuedAudioSize(device_id) > 0) {
+    // 重采样器里还留着最后一点音频，也要写进文件和播放
+    uint8_t *tail;
+    ret = audio_converter_drain(&converter, &tail);
+    if (ret < 0) {
+        printf("Resample error\n");
+    } else if (ret > 0) {
+        int tail_size = ret * sample_bytes;
+        if (recording && wav_writer_write(&wav, tail, tail_size) < 0) {
+            printf("Could not write %s, stop recording\n", wav_filename);
+            wav_writer_close(&wav);
+            recording = 0;
+        }
+        if (audio_ring_wait(&audio_ring, tail_size, NULL) == 0) {
+            audio_ring_write(&audio_ring, tail, tail_size);
+        }
+    }
+    decode_stats_print(&decode_stats, "audio");
+    decoder_print_stats(&decoder, "audio");
+    demux_stats_print(&demux_stats, fmt_ctx);
+    if (recording && wav_writer_close(&wav) < 0) {
+        printf("Could not write %s\n", wav_filename);
+    }
+    // 等待缓冲区的音频播放完
+    while (audio_ring_buffered(&audio_ring) > 0) {
         SDL_Delay(100);
     }
+    // 先关掉设备，回调不会再读缓冲区
+    SDL_CloseAudioDevice(device_id);
+    audio_ring_print_stats(&audio_ring);
 
     // 清理分配的资源
+    audio_converter_free(&converter);
     av_frame_free(&frame);
-    av_frame_free(&frame_resample);
     av_packet_free(&packet);
-    avcodec_close(audio_codec_ctx);
-    avformat_close_input(&fmt_ctx);
+    audio_ring_destroy(&audio_ring);
+    decoder_close(&decoder);
+    media_source_close(&source);
 
     // 清理 sdl 资源
     SDL_Quit();
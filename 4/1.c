@@ -2,7 +2,7 @@
 #include <fcntl.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
+#include <libavutil/channel_layout.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 #include <stdint.h>
@@ -11,6 +11,11 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/media.h"
+
 SDL_Renderer *renderer;
 SDL_Window *window;
 SDL_Texture *texture;
@@ -57,29 +62,25 @@ init_sdl(int width, int height, int sample_rate, int sample_format, int channels
 
 int
 main(int argc, char const *argv[]) {
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
+    const char *filename = argc > 1 ? argv[1] : "video.mp4";
     init_sdl(1920, 1080, 44100, AUDIO_F32, 2);
 
-    const char *filename = "video.mp4";
     int ret;
-    AVFormatContext *fmt_ctx = NULL;
-
-    // 打开视频文件
-    // 套路代码，注意第一个参数是 fmt_ctx 的地址
-    // 因为是函数内部实际创建 AVFormatContext，并修改 fmt_ctx 的值
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
-    if (ret < 0) {
-        printf("Could not open file %s\n", filename);
-        return -1;
-    }
 
-    // 获取 stream 信息，写入到 fmt_ctx 中
-    // nb_streams 表示 stream 的个数
-    // streams 数组保存所有的 stream 结构
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    // 打开视频文件，获取 stream 信息，找到音视频流
+    // 只要这两路流，其他音轨和字幕的 packet 解复用时就跳过
+    MediaSource source;
+    ret = media_source_open(&source, filename, NULL, &probe_opts, DEMUX_WANT_VIDEO | DEMUX_WANT_AUDIO, &startup);
     if (ret < 0) {
-        printf("Could not find stream info %s\n", filename);
         return -1;
     }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
 
     // 打印视频的详细信息
     // 第一个参数是文件的 AVFormatContext
@@ -87,120 +88,94 @@ main(int argc, char const *argv[]) {
     // 其他参数不用管，写 0
     av_dump_format(fmt_ctx, 0, filename, 0);
 
-    // 找到视频流
-    int video_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-        }
-    }
-    if (video_stream_index == -1) {
-        printf("Could not find video stream\n");
-        return -1;
-    }
-    AVStream *video_stream = fmt_ctx->streams[video_stream_index];
-    // 找到视频流的解码器
-    AVCodec *video_codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    if (video_codec == NULL) {
-        printf("Unsupported video codec\n");
-        return -1;
-    }
-    AVCodecContext *video_codec_ctx = avcodec_alloc_context3(video_codec);
-    avcodec_parameters_to_context(video_codec_ctx, video_stream->codecpar);
-    ret = avcodec_open2(video_codec_ctx, video_codec, NULL);
-    if (ret < 0) {
-        printf("Could not open video codec\n");
-        return -1;
-    }
-
-    // 找到音频流
-    int audio_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            audio_stream_index = i;
-        }
-    }
-    if (audio_stream_index == -1) {
-        printf("Could not find audio stream\n");
-        return -1;
-    }
-    AVStream *audio_stream = fmt_ctx->streams[audio_stream_index];
-    // 找到音频解码器
-    AVCodec *audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
-    if (audio_codec == NULL) {
-        printf("Unsupported audio codec\n");
-        return -1;
-    }
-    AVCodecContext *audio_codec_ctx = avcodec_alloc_context3(audio_codec);
-    avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
-    ret = avcodec_open2(audio_codec_ctx, audio_codec, NULL);
-    if (ret < 0) {
-        printf("Could not open audio codec\n");
+    // 找到音视频流的解码器，配置好多线程后打开
+    Decoder video_decoder = {0};
+    Decoder audio_decoder = {0};
+    if (decoder_open(&video_decoder, fmt_ctx, source.video_index, &decoder_opts) < 0 ||
+        decoder_open(&audio_decoder, fmt_ctx, source.audio_index, &decoder_opts) < 0) {
+        decoder_close(&video_decoder);
+        media_source_close(&source);
         return -1;
     }
+    AVCodecContext *video_codec_ctx = video_decoder.codec_ctx;
+    AVCodecContext *audio_codec_ctx = audio_decoder.codec_ctx;
+    int video_stream_index = source.video_index;
+    int audio_stream_index = source.audio_index;
 
     int width = video_codec_ctx->width;
     int height = video_codec_ctx->height;
-    int pix_fmt = video_codec_ctx->pix_fmt;
 
     int channels = audio_codec_ctx->channels;
     int sample_rate = audio_codec_ctx->sample_rate;
     int format = audio_codec_ctx->sample_fmt;
-    int layout = audio_codec_ctx->channel_layout;
+    // 有些解码器不填声道布局，按声道数取默认布局
+    uint64_t layout = audio_codec_ctx->channel_layout;
+    if (layout == 0) {
+        layout = av_get_default_channel_layout(channels);
+    }
     printf("channels: %d, saple_rate: %d, format: %d\n", channels, sample_rate, format);
 
     // 保存解码出的数据帧
     AVFrame *frame = av_frame_alloc();
     AVFrame *frame_scale = av_frame_alloc();
     AVFrame *frame_resample = av_frame_alloc();
-    frame_resample->channel_layout = layout;
-    frame_resample->sample_rate = sample_rate;
-    frame_resample->channels = channels;
-    frame_resample->format = AV_SAMPLE_FMT_FLT;
 
     AVPacket *packet = av_packet_alloc();
 
-    // 重采样转换音频格式
-    SwrContext *swr_ctx = swr_alloc_set_opts(NULL,              // we're allocating a new context
-                                             layout,            // out_ch_layout
-                                             AV_SAMPLE_FMT_FLT, // out_sample_fmt
-                                             sample_rate,       // out_sample_rate
-                                             layout,            // in_ch_layout
-                                             format,            // in_sample_fmt
-                                             sample_rate,       // in_sample_rate
-                                             0,                 // log_offset
-                                             NULL);             // log_ctx
-
-    struct SwsContext *sws_ctx = sws_getContext(width,              // the width of the source image
-                                                height,             // the height of the source image
-                                                pix_fmt,            // the source image format
-                                                width,              // the width of the destination image
-                                                height,             // the height of the destination image
-                                                AV_PIX_FMT_YUV420P, // the destination image format
-                                                SWS_BILINEAR,       // algorithm and options
-                                                NULL,               // the filter of the source image
-                                                NULL,               // the filter of the source image
-                                                NULL                // extra parameters to tune the used scaler
-    );
-    int buffer_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 32);
-    uint8_t *buffer = av_malloc(sizeof(uint8_t) * buffer_size);
-    av_image_fill_arrays(frame_scale->data, frame_scale->linesize, buffer, AV_PIX_FMT_YUV420P, width, height, 32);
-
-    while (av_read_frame(fmt_ctx, packet) == 0) {
-        // 只要音频
-        if (packet->stream_index == audio_stream_index) {
-            // 把 packet 中的数据传给解码器进行解码
-            ret = avcodec_send_packet(audio_codec_ctx, packet);
-            if (ret < 0) {
-                printf("Error decoding\n");
-                return -1;
+    // 重采样和图像转换的上下文按每一帧的实际参数创建并缓存，流中途改变格式也能正确转换
+    AudioConverter audio_converter;
+    audio_converter_init(&audio_converter, layout, AV_SAMPLE_FMT_FLT, sample_rate);
+    // 转换后的图像放在转换器池里的内存上，每帧用完还回去
+    VideoConverter video_converter;
+    if (video_converter_init(&video_converter, width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR) < 0) {
+        printf("Could not create converter\n");
+        return -1;
+    }
+
+    DecodeStats audio_stats;
+    DecodeStats video_stats;
+    decode_stats_init(&audio_stats);
+    decode_stats_init(&video_stats);
+    DemuxStats demux_stats;
+    demux_stats_init(&demux_stats);
+    while (1) {
+        Decoder *dec = NULL;
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，依次排空两个解码器，把缓存的帧都取出来，都排空了才结束
+            if (audio_decoder.drain == DECODER_DRAIN_NONE) {
+                dec = &audio_decoder;
+            } else if (video_decoder.drain == DECODER_DRAIN_NONE) {
+                dec = &video_decoder;
+            } else {
+                break;
+            }
+            ret = decoder_send_packet(dec, NULL);
+        } else {
+            demux_stats_packet(&demux_stats, packet,
+                               packet->stream_index == audio_stream_index ||
+                                   packet->stream_index == video_stream_index);
+            if (packet->stream_index == audio_stream_index) {
+                dec = &audio_decoder;
+            } else if (packet->stream_index == video_stream_index) {
+                dec = &video_decoder;
+            }
+            // 把 packet 中的数据传给解码器进行解码，packet 继续用来读下一个
+            if (dec != NULL) {
+                ret = decoder_send_packet(dec, packet);
+            } else {
+                av_packet_unref(packet);
             }
+        }
+        if (ret < 0) {
+            printf("Error decoding\n");
+            return -1;
+        }
 
+        if (dec == &audio_decoder) {
             // packet 里可能有多个完整的 frame
             while (1) {
-                ret = avcodec_receive_frame(audio_codec_ctx, frame);
+                ret = decoder_receive_frame(dec, frame);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     break;
                 } else if (ret < 0) {
@@ -208,8 +183,10 @@ main(int argc, char const *argv[]) {
                     return -1;
                 }
 
+                decode_stats_frame(&audio_stats);
+
                 // 转换音频格式
-                ret = swr_convert_frame(swr_ctx, frame_resample, frame);
+                ret = audio_converter_convert(&audio_converter, frame, frame_resample);
                 if (ret < 0) {
                     printf("Resample error\n");
                     return -1;
@@ -219,21 +196,12 @@ main(int argc, char const *argv[]) {
                                  av_get_bytes_per_sample(frame_resample->format);
                 // printf("frame sample %d, %d\n", frame->linesize[0], frame_size);
                 SDL_QueueAudio(audio_device, frame_resample->data[0], frame_size);
-                // 释放 packet 内部数据，并把 packet 一些自动设为默认值
-                av_packet_unref(packet);
+                av_frame_unref(frame_resample);
             }
-        } else if (packet->stream_index == video_stream_index) {
-            // 把 packet 中的数据传给解码器进行解码
-            // 把 packet 中的数据传给解码器进行解码
-            ret = avcodec_send_packet(video_codec_ctx, packet);
-            if (ret < 0) {
-                printf("Error decoding\n");
-                return -1;
-            }
-
+        } else if (dec == &video_decoder) {
             // packet 里可能有多个完整的 frame
             while (1) {
-                ret = avcodec_receive_frame(video_codec_ctx, frame);
+                ret = decoder_receive_frame(dec, frame);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     break;
                 } else if (ret < 0) {
@@ -241,8 +209,12 @@ main(int argc, char const *argv[]) {
                     return -1;
                 }
 
-                sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, height, frame_scale->data,
-                          frame_scale->linesize);
+                decode_stats_frame(&video_stats);
+
+                if (video_converter_convert(&video_converter, frame, frame_scale) < 0) {
+                    printf("Could not convert video frame\n");
+                    continue;
+                }
 
                 SDL_Rect rect;
                 rect.x = 0;
@@ -252,6 +224,7 @@ main(int argc, char const *argv[]) {
                 SDL_UpdateYUVTexture(texture, &rect, frame_scale->data[0], frame_scale->linesize[0],
                                      frame_scale->data[1], frame_scale->linesize[1], frame_scale->data[2],
                                      frame_scale->linesize[2]);
+                av_frame_unref(frame_scale);
                 // clear the current rendering target with the drawing color
                 SDL_RenderClear(renderer);
 
@@ -265,6 +238,7 @@ main(int argc, char const *argv[]) {
 
                 // update the screen with any rendering performed since the previous call
                 SDL_RenderPresent(renderer);
+                startup_timer_first_frame(&startup);
             }
         }
 
@@ -274,6 +248,9 @@ main(int argc, char const *argv[]) {
         switch (event.type) {
         case SDL_QUIT: {
             printf("quit event\n");
+            decode_stats_print(&audio_stats, "audio");
+            decode_stats_print(&video_stats, "video");
+            demux_stats_print(&demux_stats, fmt_ctx);
             SDL_Quit();
             exit(0);
         } break;
@@ -283,6 +260,11 @@ main(int argc, char const *argv[]) {
         } break;
         }
     }
+    decode_stats_print(&audio_stats, "audio");
+    decode_stats_print(&video_stats, "video");
+    decoder_print_stats(&audio_decoder, "audio");
+    decoder_print_stats(&video_decoder, "video");
+    demux_stats_print(&demux_stats, fmt_ctx);
     // printf("wav length: %d\n", wav_length);
     // save_wave("sound1.wav", wav_buf, wav_length, sample_rate, channels, 32);
     // 等待队列的音频播放完
@@ -291,11 +273,15 @@ main(int argc, char const *argv[]) {
     }
 
     // 清理分配的资源
+    audio_converter_free(&audio_converter);
+    video_converter_free(&video_converter);
     av_frame_free(&frame);
+    av_frame_free(&frame_scale);
     av_frame_free(&frame_resample);
     av_packet_free(&packet);
-    avcodec_close(audio_codec_ctx);
-    avformat_close_input(&fmt_ctx);
+    decoder_close(&video_decoder);
+    decoder_close(&audio_decoder);
+    media_source_close(&source);
 
     // 清理 sdl 资源
     SDL_Quit();
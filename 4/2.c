@@ -5,34 +5,558 @@
 #include <libavutil/imgutils.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "../common/audio_ring.h"
+#include "../common/av_sync.h"
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/file_io.h"
+#include "../common/media.h"
+#include "../common/pool.h"
+#include "../common/queue.h"
+#include "../common/sdl_audio.h"
+#include "../common/sdl_video.h"
+#include "../common/seek_index.h"
+#include "../common/volume.h"
+
 SDL_Renderer *renderer;
 SDL_Window *window;
 SDL_Texture *texture;
 SDL_AudioDeviceID audio_device;
+// 音频解码线程写入，SDL 音频回调读出
+AudioRing audio_ring;
+// 主线程按键修改，SDL 音频回调应用
+Volume volume;
+
+// 队列默认大小，可以用命令行参数修改
+#define PACKET_QUEUE_COUNT 256
+#define PACKET_QUEUE_BYTES (16 * 1024 * 1024)
+#define FRAME_QUEUE_COUNT 8
+#define FRAME_QUEUE_BYTES (64 * 1024 * 1024)
+// 音频缓冲区默认的延迟目标（毫秒），缓冲区里的数据超过这个时长音频解码线程就等待
+#define AUDIO_LATENCY_MS 200
+// 音频缓冲区除了延迟目标之外预留的空间，要放得下一帧转换后的音频
+#define AUDIO_MAX_CHUNK (1024 * 1024)
+// 左右方向键和上下方向键 seek 的秒数
+#define SEEK_SHORT 10
+#define SEEK_LONG 60
+// seek 之后放进 packet 队列的标记，stream_index 是这个值，pts 是 seek 的目标时间（AV_TIME_BASE）
+#define FLUSH_STREAM_INDEX -1
+// 读到文件末尾时放进 packet 队列的标记，解码线程收到后排空解码器
+#define EOF_STREAM_INDEX -2
+// 解码线程退出后记录的 eof serial，不管当前 serial 是多少都算解码完了
+#define DECODE_EXITED INT_MAX
+
+// 播放器的全部状态，在各个线程之间共享
+// 解复用线程 -> 音频/视频 packet 队列 -> 音频/视频解码线程 -> 视频 frame 队列 -> 主线程渲染
+typedef struct PlayerState {
+    AVFormatContext *fmt_ctx;
+    int video_stream_index;
+    int audio_stream_index;
+    Decoder *video_decoder;
+    Decoder *audio_decoder;
+    // 纹理的大小和像素格式
+    int width;
+    int height;
+    enum AVPixelFormat out_pix_fmt;
+    AVRational audio_time_base;
+    // 音频转换后的参数，就是音频设备实际打开的参数
+    uint64_t out_layout;
+    enum AVSampleFormat out_sample_fmt;
+    int out_sample_rate;
+
+    Queue video_packets;
+    Queue audio_packets;
+    Queue video_frames;
+    // 队列里的 packet 和 frame 从池里取，用完放回去，播放过程中不再反复分配
+    PacketPool packet_pool;
+    FramePool frame_pool;
+    DemuxStats demux_stats;
+
+    // 音视频同步，音频相关的字段在 sync_mutex 保护下访问
+    AVSync sync;
+    SDL_mutex *sync_mutex;
+
+    // seek 请求，主线程先写 seek_target（AV_TIME_BASE）再把 seek_request 加 1
+    // 解复用线程处理完（serial 已经加过）把 seek_done 设成处理的那个 seek_request，两个不相等说明还有 seek 没处理完
+    atomic_llong seek_target;
+    atomic_int seek_request;
+    atomic_int seek_done;
+    // 解复用线程读到文件末尾后睡在 demux_cond 上，主线程发出 seek 或者退出时唤醒它
+    SDL_mutex *demux_mutex;
+    SDL_cond *demux_cond;
+    // 每 seek 一次加 1，由解复用线程修改
+    // 解码线程每取到一个 flush 标记把自己的 serial 加 1，和这里不相等时取到的 packet 都是 seek 之前的，直接丢掉
+    // 视频帧的 opaque 里记录解码时的 serial，主线程丢掉旧的帧
+    atomic_int serial;
+    // 解码线程把某个 serial 的数据全部解码完（收到 EOF 标记并排空）时记录这个 serial，退出时设为 DECODE_EXITED
+    // 和当前 serial 相等说明这个位置之后没有新数据了，主线程据此判断播放结束
+    atomic_int audio_eof_serial;
+    atomic_int video_eof_serial;
+    // tools/seek_index 生成的关键帧索引，没有时为 NULL
+    SeekIndex *seek_index;
+
+    // 用户退出或者出错，所有线程尽快结束
+    atomic_int quit;
+} PlayerState;
+
+// 往两个 packet 队列各放一个标记，stream_index 是 FLUSH_STREAM_INDEX 或者 EOF_STREAM_INDEX
+int
+push_marker(PlayerState *ps, int stream_index, int64_t pts) {
+    Queue *queues[] = {&ps->video_packets, &ps->audio_packets};
+    for (int i = 0; i < 2; i++) {
+        AVPacket *p = packet_pool_get(&ps->packet_pool);
+        if (p == NULL) {
+            return -1;
+        }
+        p->stream_index = stream_index;
+        p->pts = pts;
+        if (queue_push(queues[i], p, 0) < 0) {
+            packet_pool_put(&ps->packet_pool, &p);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 主线程修改 seek_request 或者 quit 之后调用
+void
+wake_demux(PlayerState *ps) {
+    SDL_LockMutex(ps->demux_mutex);
+    SDL_CondSignal(ps->demux_cond);
+    SDL_UnlockMutex(ps->demux_mutex);
+}
+
+// 在解复用线程里执行 seek，成功后通知解码线程丢掉旧数据
+int
+demux_seek(PlayerState *ps, int64_t target) {
+    int ret;
+    if (ps->seek_index != NULL) {
+        // 有索引时直接二分查找视频流在 target 之前的关键帧
+        AVRational time_base = ps->fmt_ctx->streams[ps->video_stream_index]->time_base;
+        int64_t key_pts;
+        ret = seek_index_seek(ps->seek_index, ps->fmt_ctx, ps->video_stream_index,
+                              av_rescale_q(target, AV_TIME_BASE_Q, time_base), &key_pts);
+    } else {
+        // 跳到 target 之前最近的关键帧，解码线程再把 target 之前的帧丢掉
+        ret = avformat_seek_file(ps->fmt_ctx, -1, INT64_MIN, target, target, 0);
+    }
+    if (ret < 0) {
+        printf("Could not seek to %.2fs\n", target / (double)AV_TIME_BASE);
+        return ret;
+    }
+
+    atomic_fetch_add(&ps->serial, 1);
+    return push_marker(ps, FLUSH_STREAM_INDEX, target);
+}
+
+// 读取文件里的 packet，按流分发到对应的队列
+// 读到文件末尾不退出，等着 seek 或者退出，seek 回去以后接着读
+int
+demux_thread(void *arg) {
+    PlayerState *ps = arg;
+    AVPacket *packet = av_packet_alloc();
+    int seek_done = 0;
+    // 已经给当前位置发过 EOF 标记，seek 成功之前不再读
+    int eof = 0;
+    while (!atomic_load(&ps->quit)) {
+        // 先读请求再读目标，处理期间来的新请求下一轮再处理
+        int seek_request = atomic_load(&ps->seek_request);
+        if (seek_request != seek_done) {
+            if (demux_seek(ps, atomic_load(&ps->seek_target)) == 0) {
+                eof = 0;
+            } else if (atomic_load(&ps->quit)) {
+                break;
+            }
+            seek_done = seek_request;
+            atomic_store(&ps->seek_done, seek_done);
+        }
+        if (eof) {
+            // 在锁里检查，主线程改完状态再加锁唤醒，不会漏掉
+            SDL_LockMutex(ps->demux_mutex);
+            while (!atomic_load(&ps->quit) && atomic_load(&ps->seek_request) == seek_done) {
+                SDL_CondWait(ps->demux_cond, ps->demux_mutex);
+            }
+            SDL_UnlockMutex(ps->demux_mutex);
+            continue;
+        }
+        if (av_read_frame(ps->fmt_ctx, packet) < 0) {
+            // 通知解码线程把解码器里缓存的帧取出来，标记只发一次，重复排空解码器会返回错误
+            if (push_marker(ps, EOF_STREAM_INDEX, AV_NOPTS_VALUE) < 0) {
+                break;
+            }
+            eof = 1;
+            continue;
+        }
+        demux_stats_packet(&ps->demux_stats, packet,
+                           packet->stream_index == ps->video_stream_index ||
+                               packet->stream_index == ps->audio_stream_index);
+
+        Queue *q = NULL;
+        if (packet->stream_index == ps->video_stream_index) {
+            q = &ps->video_packets;
+        } else if (packet->stream_index == ps->audio_stream_index) {
+            q = &ps->audio_packets;
+        }
+        if (q == NULL) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // 把数据转移到池里取出的 packet 放进队列，packet 本身继续用来读下一个
+        AVPacket *p = packet_pool_get(&ps->packet_pool);
+        if (p == NULL) {
+            av_packet_unref(packet);
+            break;
+        }
+        av_packet_move_ref(p, packet);
+        if (queue_push(q, p, p->size) < 0) {
+            packet_pool_put(&ps->packet_pool, &p);
+            break;
+        }
+    }
+
+    queue_finish(&ps->video_packets);
+    queue_finish(&ps->audio_packets);
+    av_packet_free(&packet);
+    return 0;
+}
+
+// 转换好的音频写进缓冲区，pts 小于 0 表示紧接着上一块，要退出时返回 -1
+int
+play_audio(PlayerState *ps, const uint8_t *data, int size, double pts) {
+    // 缓冲区里的数据达到延迟目标就等回调取走一些，不会把整个文件都解码进内存
+    if (audio_ring_wait(&audio_ring, size, &ps->quit) < 0) {
+        return -1;
+    }
+    // 写入数据和更新音频时钟要一起完成，否则主线程可能看到不一致的时钟
+    // 回调只读缓冲区，不碰这把锁，不会被解码线程卡住
+    SDL_LockMutex(ps->sync_mutex);
+    audio_ring_write(&audio_ring, data, size);
+    av_sync_audio_written(&ps->sync, pts, size);
+    SDL_UnlockMutex(ps->sync_mutex);
+    return 0;
+}
+
+// 解码音频，转换格式后交给 SDL 播放
+int
+audio_decode_thread(void *arg) {
+    PlayerState *ps = arg;
+    AVFrame *frame = av_frame_alloc();
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+    // 按每一帧的实际参数取转换上下文，流中途改变格式也能正确转换
+    // 直接转换成设备的采样率、格式和声道，转换结果放在转换器自己的缓冲区里，每帧不用分配内存
+    AudioConverter converter;
+    audio_converter_init(&converter, ps->out_layout, ps->out_sample_fmt, ps->out_sample_rate);
+    int sample_bytes = converter.channels * av_get_bytes_per_sample(converter.format);
+    int serial = 0;
+    // seek 之后结束时间在这之前的音频帧丢掉，单位秒
+    double skip_until = -1;
+
+    int ret = 0;
+    while (1) {
+        AVPacket *packet = queue_pop(&ps->audio_packets);
+        if (packet == NULL) {
+            // 队列被取消是要退出了，或者解复用线程出错退出
+            break;
+        } else if (packet->stream_index == FLUSH_STREAM_INDEX) {
+            // seek 了，清空解码器、重采样器和还没播放的音频，音频时钟从新位置重新开始
+            decoder_flush(ps->audio_decoder);
+            audio_converter_reset(&converter);
+            serial += 1;
+            skip_until = packet->pts / (double)AV_TIME_BASE;
+            packet_pool_put(&ps->packet_pool, &packet);
+            SDL_LockAudioDevice(audio_device);
+            SDL_LockMutex(ps->sync_mutex);
+            audio_ring_clear(&audio_ring);
+            av_sync_audio_flush(&ps->sync);
+            SDL_UnlockMutex(ps->sync_mutex);
+            SDL_UnlockAudioDevice(audio_device);
+            continue;
+        } else if (serial != atomic_load(&ps->serial)) {
+            // seek 之前读出来的 packet
+            packet_pool_put(&ps->packet_pool, &packet);
+            continue;
+        } else if (packet->stream_index == EOF_STREAM_INDEX) {
+            // 文件读完了，把解码器里缓存的音频也取出来播放
+            packet_pool_put(&ps->packet_pool, &packet);
+            ret = decoder_send_packet(ps->audio_decoder, NULL);
+        } else {
+            // 把 packet 中的数据传给解码器进行解码
+            ret = decoder_send_packet(ps->audio_decoder, packet);
+            packet_pool_put(&ps->packet_pool, &packet);
+        }
+        if (ret < 0) {
+            printf("Error decoding audio\n");
+            break;
+        }
+
+        // packet 里可能有多个完整的 frame
+        while (1) {
+            ret = decoder_receive_frame(ps->audio_decoder, frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                printf("Error decoding audio\n");
+                break;
+            }
+
+            decode_stats_frame(&decode_stats);
+
+            double pts = -1;
+            if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+                pts = frame->best_effort_timestamp * av_q2d(ps->audio_time_base);
+            }
+            if (skip_until >= 0 && pts >= 0 && pts + (double)frame->nb_samples / frame->sample_rate <= skip_until) {
+                // 从关键帧解码到 seek 目标之前的部分不播放
+                av_frame_unref(frame);
+                continue;
+            }
+            skip_until = -1;
+
+            // 转换音频格式
+            uint8_t *data;
+            ret = audio_converter_convert_buffer(&converter, frame, &data);
+            if (ret < 0) {
+                printf("Resample error\n");
+                break;
+            }
+
+            if (play_audio(ps, data, ret * sample_bytes, pts) < 0) {
+                ret = AVERROR_EXIT;
+                break;
+            }
+        }
+        if (ret == AVERROR_EOF) {
+            // 重采样器里还留着最后一点音频，取出来接在后面播放
+            uint8_t *data;
+            int samples = audio_converter_drain(&converter, &data);
+            if (samples > 0 && play_audio(ps, data, samples * sample_bytes, -1) < 0) {
+                break;
+            }
+            // 排空结束，线程不退出，等 seek 的 flush 标记重置解码器后继续解码
+            atomic_store(&ps->audio_eof_serial, serial);
+        } else if (ret != AVERROR(EAGAIN)) {
+            // 出错或者要退出了
+            break;
+        }
+    }
+
+    atomic_store(&ps->audio_eof_serial, DECODE_EXITED);
+
+    decode_stats_print(&decode_stats, "audio");
+    decoder_print_stats(ps->audio_decoder, "audio");
+    // 出错提前退出时取消输入队列，让解复用线程不再等待
+    queue_abort(&ps->audio_packets);
+    audio_converter_free(&converter);
+    av_frame_free(&frame);
+    return 0;
+}
 
+// 解码视频，转换成 yuv420p 后放进 frame 队列，由主线程渲染
+int
+video_decode_thread(void *arg) {
+    PlayerState *ps = arg;
+    AVFrame *frame = av_frame_alloc();
+    int frame_bytes = av_image_get_buffer_size(ps->out_pix_fmt, ps->width, ps->height, 1);
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+    // 分辨率或格式中途变化时按新参数取转换上下文，都转换成纹理的大小和格式
+    // 转换后的图像放在转换器池里的内存上，主线程显示完释放 frame 时还回去
+    VideoConverter converter;
+    if (video_converter_init(&converter, ps->width, ps->height, ps->out_pix_fmt, SWS_BILINEAR) < 0) {
+        printf("Could not create converter\n");
+        queue_finish(&ps->video_frames);
+        queue_abort(&ps->video_packets);
+        av_frame_free(&frame);
+        return -1;
+    }
+    AVRational time_base = ps->fmt_ctx->streams[ps->video_stream_index]->time_base;
+    int serial = 0;
+    // seek 之后 pts 在这之前的帧丢掉，单位是流的 time_base
+    int64_t skip_until = AV_NOPTS_VALUE;
+
+    int ret = 0;
+    while (1) {
+        AVPacket *packet = queue_pop(&ps->video_packets);
+        if (packet == NULL) {
+            // 队列被取消是要退出了，或者解复用线程出错退出
+            break;
+        } else if (packet->stream_index == FLUSH_STREAM_INDEX) {
+            // seek 了，解码器里参考帧和缓存的帧都是旧位置的
+            decoder_flush(ps->video_decoder);
+            serial += 1;
+            skip_until = av_rescale_q(packet->pts, AV_TIME_BASE_Q, time_base);
+            packet_pool_put(&ps->packet_pool, &packet);
+            continue;
+        } else if (serial != atomic_load(&ps->serial)) {
+            // seek 之前读出来的 packet
+            packet_pool_put(&ps->packet_pool, &packet);
+            continue;
+        } else if (packet->stream_index == EOF_STREAM_INDEX) {
+            // 文件读完了，把解码器里缓存的帧也取出来显示
+            packet_pool_put(&ps->packet_pool, &packet);
+            ret = decoder_send_packet(ps->video_decoder, NULL);
+        } else {
+            // 把 packet 中的数据传给解码器进行解码
+            ret = decoder_send_packet(ps->video_decoder, packet);
+            packet_pool_put(&ps->packet_pool, &packet);
+        }
+        if (ret < 0) {
+            printf("Error decoding video\n");
+            break;
+        }
+
+        // packet 里可能有多个完整的 frame
+        while (1) {
+            ret = decoder_receive_frame(ps->video_decoder, frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                printf("Error decoding video\n");
+                break;
+            }
+
+            decode_stats_frame(&decode_stats);
+
+            int64_t pts = frame->best_effort_timestamp;
+            if (skip_until != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts < skip_until) {
+                // 从关键帧解码到 seek 目标之前的帧不显示，从目标时间准确开始
+                av_frame_unref(frame);
+                continue;
+            }
+            skip_until = AV_NOPTS_VALUE;
+            AVFrame *frame_scale;
+            if (video_converter_passthrough(&converter, frame)) {
+                // 格式和纹理相同时把解码出的数据整个转移到池里的 frame 交给渲染线程，不转换也不拷贝
+                // 图像内存还在解码器的内存池里，渲染线程放回 frame 时才还给解码器
+                frame_scale = frame_pool_move(&ps->frame_pool, frame);
+                ret = frame_scale == NULL ? AVERROR(ENOMEM) : 0;
+            } else {
+                frame_scale = frame_pool_get(&ps->frame_pool);
+                ret = frame_scale == NULL ? AVERROR(ENOMEM) : video_converter_convert(&converter, frame, frame_scale);
+            }
+            av_frame_unref(frame);
+            if (ret < 0) {
+                printf("Could not convert video frame\n");
+                frame_pool_put(&ps->frame_pool, &frame_scale);
+                continue;
+            }
+            frame_scale->pts = pts;
+            frame_scale->opaque = (void *)(intptr_t)serial;
+
+            if (queue_push(&ps->video_frames, frame_scale, frame_bytes) < 0) {
+                frame_pool_put(&ps->frame_pool, &frame_scale);
+                ret = AVERROR_EXIT;
+                break;
+            }
+        }
+        if (ret == AVERROR_EOF) {
+            // 排空结束，帧都已经放进队列，线程不退出，等 seek 的 flush 标记重置解码器后继续解码
+            atomic_store(&ps->video_eof_serial, serial);
+        } else if (ret != AVERROR(EAGAIN)) {
+            // 出错或者要退出了
+            break;
+        }
+    }
+
+    atomic_store(&ps->video_eof_serial, DECODE_EXITED);
+    queue_finish(&ps->video_frames);
+    decode_stats_print(&decode_stats, "video");
+    decoder_print_stats(ps->video_decoder, "video");
+    // 出错提前退出时取消输入队列，让解复用线程不再等待
+    queue_abort(&ps->video_packets);
+    video_converter_free(&converter);
+    av_frame_free(&frame);
+    return 0;
+}
+
+// 释放队列里剩下的数据
+void
+free_packet_queue(Queue *q, PacketPool *pool) {
+    AVPacket *packet;
+    while ((packet = queue_try_pop(q)) != NULL) {
+        packet_pool_put(pool, &packet);
+    }
+    queue_destroy(q);
+}
+
+void
+free_frame_queue(Queue *q, FramePool *pool) {
+    AVFrame *frame;
+    while ((frame = queue_try_pop(q)) != NULL) {
+        frame_pool_put(pool, &frame);
+    }
+    queue_destroy(q);
+}
+
+// 当前位置之后的音视频都解码完了，视频帧也都显示了，并且没有还没处理的 seek
+int
+playback_finished(PlayerState *ps) {
+    // 解复用线程先加 serial 再更新 seek_done，看到 seek 处理完时 serial 一定是新的
+    if (atomic_load(&ps->seek_request) != atomic_load(&ps->seek_done)) {
+        return 0;
+    }
+    int serial = atomic_load(&ps->serial);
+    int audio_eof = atomic_load(&ps->audio_eof_serial);
+    int video_eof = atomic_load(&ps->video_eof_serial);
+    // 解码线程先把帧放进队列再记录 eof serial，这里最后看队列
+    return (audio_eof == serial || audio_eof == DECODE_EXITED) &&
+           (video_eof == serial || video_eof == DECODE_EXITED) && queue_count(&ps->video_frames) == 0;
+}
+
+// 解析 --name=value 形式的参数，不匹配返回 0
+int
+parse_option(const char *arg, const char *name, int64_t *value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+        return 0;
+    }
+    *value = strtoll(arg + len + 1, NULL, 10);
+    return 1;
+}
+
+// SDL 在自己的音频线程里调用，需要多少数据就从缓冲区取多少，不够的部分补静音
+void
+audio_callback(void *userdata, Uint8 *stream, int len) {
+    audio_ring_fill(userdata, stream, len);
+    // 在取出来的数据上原地调整音量，按键后下一次回调就能听到
+    volume_apply(&volume, stream, len);
+}
+
+// 按音频流的参数请求，设备实际打开的参数写到 obtained 里，音频解码线程直接转换成这个参数
+// 设备打开后是暂停的，缓冲区准备好以后再开始播放
 SDL_AudioDeviceID
-open_audio_device(int sample_rate, int sample_format, int channels) {
+open_audio_device(int sample_rate, int channels, SDL_AudioSpec *obtained) {
     SDL_AudioSpec wav_spec;
+    SDL_zero(wav_spec);
     wav_spec.freq = sample_rate;
-    wav_spec.format = sample_format;
+    wav_spec.format = AUDIO_F32SYS;
     wav_spec.channels = channels;
     wav_spec.samples = 4096;
 
-    // 使用 SDL_QueueAudio，需要把这俩设置为 NULL
-    wav_spec.callback = NULL;
-    wav_spec.userdata = NULL;
+    // 设备需要数据时调用回调，从 audio_ring 里取
+    wav_spec.callback = audio_callback;
+    wav_spec.userdata = &audio_ring;
 
-    return SDL_OpenAudioDevice(NULL, 0, &wav_spec, NULL, SDL_AUDIO_ALLOW_ANY_CHANGE);
+    SDL_AudioDeviceID device_id = sdl_audio_open(&wav_spec, obtained);
+    if (device_id == 0) {
+        fprintf(stderr, "Couldn't open audio: %s\n", SDL_GetError());
+        exit(-1);
+    }
+    return device_id;
 }
 
 void
-init_sdl(int width, int height, int sample_rate, int sample_format, int channels) {
+init_sdl(int width, int height) {
     int ret;
     ret = SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO);
     if (ret != 0) {
@@ -44,42 +568,46 @@ init_sdl(int width, int height, int sample_rate, int sample_format, int channels
                               height / 2, SDL_WINDOW_ALLOW_HIGHDPI);
     renderer = SDL_CreateRenderer(window, -1,
                                   SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, width, height);
-
-    audio_device = open_audio_device(sample_rate, sample_format, channels);
-    if (audio_device < 0) {
-        fprintf(stderr, "Couldn't open audio: %s\n", SDL_GetError());
-        exit(-1);
-    }
-    // 打开的音频设备默认是静音状态，取消静音
-    SDL_PauseAudioDevice(audio_device, 0);
 }
 
 int
 main(int argc, char const *argv[]) {
-    init_sdl(1920, 1080, 44100, AUDIO_F32, 2);
-
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
+    FileIOOptions io_opts;
+    argc = file_io_parse_args(&io_opts, argc, argv);
     const char *filename = "video.mp4";
-    int ret;
-    AVFormatContext *fmt_ctx = NULL;
-
-    // 打开视频文件
-    // 套路代码，注意第一个参数是 fmt_ctx 的地址
-    // 因为是函数内部实际创建 AVFormatContext，并修改 fmt_ctx 的值
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
-    if (ret < 0) {
-        printf("Could not open file %s\n", filename);
-        return -1;
+    int64_t packet_queue_count = PACKET_QUEUE_COUNT;
+    int64_t packet_queue_bytes = PACKET_QUEUE_BYTES;
+    int64_t frame_queue_count = FRAME_QUEUE_COUNT;
+    int64_t frame_queue_bytes = FRAME_QUEUE_BYTES;
+    int64_t audio_latency_ms = AUDIO_LATENCY_MS;
+    for (int i = 1; i < argc; i++) {
+        if (parse_option(argv[i], "--packet-queue-count", &packet_queue_count) ||
+            parse_option(argv[i], "--packet-queue-bytes", &packet_queue_bytes) ||
+            parse_option(argv[i], "--frame-queue-count", &frame_queue_count) ||
+            parse_option(argv[i], "--frame-queue-bytes", &frame_queue_bytes) ||
+            parse_option(argv[i], "--audio-latency", &audio_latency_ms)) {
+            continue;
+        }
+        filename = argv[i];
     }
 
-    // 获取 stream 信息，写入到 fmt_ctx 中
-    // nb_streams 表示 stream 的个数
-    // streams 数组保存所有的 stream 结构
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    init_sdl(1920, 1080);
+
+    int ret;
+    // 打开视频文件，获取 stream 信息，找到音视频流
+    // 按 --io 参数选择读文件的方式，其他音轨和字幕的 packet 解复用时就跳过
+    MediaSource source;
+    ret = media_source_open(&source, filename, &io_opts, &probe_opts, DEMUX_WANT_VIDEO | DEMUX_WANT_AUDIO, &startup);
     if (ret < 0) {
-        printf("Could not find stream info %s\n", filename);
         return -1;
     }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
 
     // 打印视频的详细信息
     // 第一个参数是文件的 AVFormatContext
@@ -87,173 +615,158 @@ main(int argc, char const *argv[]) {
     // 其他参数不用管，写 0
     av_dump_format(fmt_ctx, 0, filename, 0);
 
-    // 找到视频流
-    int video_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-        }
-    }
-    if (video_stream_index == -1) {
-        printf("Could not find video stream\n");
-        return -1;
-    }
-    AVStream *video_stream = fmt_ctx->streams[video_stream_index];
-    // 找到视频流的解码器
-    AVCodec *video_codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    if (video_codec == NULL) {
-        printf("Unsupported video codec\n");
-        return -1;
-    }
-    AVCodecContext *video_codec_ctx = avcodec_alloc_context3(video_codec);
-    avcodec_parameters_to_context(video_codec_ctx, video_stream->codecpar);
-    ret = avcodec_open2(video_codec_ctx, video_codec, NULL);
-    if (ret < 0) {
-        printf("Could not open video codec\n");
-        return -1;
-    }
-
-    // 找到音频流
-    int audio_stream_index = -1;
-    for (size_t i = 0; i < fmt_ctx->nb_streams; i++) {
-        AVStream *s = fmt_ctx->streams[i];
-        if (s->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            audio_stream_index = i;
-        }
-    }
-    if (audio_stream_index == -1) {
-        printf("Could not find audio stream\n");
-        return -1;
-    }
-    AVStream *audio_stream = fmt_ctx->streams[audio_stream_index];
-    // 找到音频解码器
-    AVCodec *audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
-    if (audio_codec == NULL) {
-        printf("Unsupported audio codec\n");
-        return -1;
-    }
-    AVCodecContext *audio_codec_ctx = avcodec_alloc_context3(audio_codec);
-    avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
-    ret = avcodec_open2(audio_codec_ctx, audio_codec, NULL);
-    if (ret < 0) {
-        printf("Could not open audio codec\n");
+    // 找到音视频流的解码器，配置好多线程后打开
+    Decoder video_decoder = {0};
+    Decoder audio_decoder = {0};
+    if (decoder_open(&video_decoder, fmt_ctx, source.video_index, &decoder_opts) < 0 ||
+        decoder_open(&audio_decoder, fmt_ctx, source.audio_index, &decoder_opts) < 0) {
+        decoder_close(&video_decoder);
+        media_source_close(&source);
         return -1;
     }
+    AVCodecContext *video_codec_ctx = video_decoder.codec_ctx;
+    AVCodecContext *audio_codec_ctx = audio_decoder.codec_ctx;
+    AVStream *video_stream = video_decoder.stream;
+    AVStream *audio_stream = audio_decoder.stream;
 
     int width = video_codec_ctx->width;
     int height = video_codec_ctx->height;
-    int pix_fmt = video_codec_ctx->pix_fmt;
+    // 解码器输出 yuv420p / nv12 时纹理直接用这个格式，frame 不用转换就能上传
+    enum AVPixelFormat out_pix_fmt = sdl_upload_pix_fmt(video_codec_ctx->pix_fmt);
+    texture = SDL_CreateTexture(renderer, sdl_texture_format(out_pix_fmt), SDL_TEXTUREACCESS_STREAMING, width, height);
 
     int channels = audio_codec_ctx->channels;
     int sample_rate = audio_codec_ctx->sample_rate;
     int format = audio_codec_ctx->sample_fmt;
-    int layout = audio_codec_ctx->channel_layout;
     printf("channels: %d, saple_rate: %d, format: %d\n", channels, sample_rate, format);
 
-    // 保存解码出的数据帧
-    AVFrame *frame = av_frame_alloc();
-    AVFrame *frame_scale = av_frame_alloc();
-    AVFrame *frame_resample = av_frame_alloc();
-    frame_resample->channel_layout = layout;
-    frame_resample->sample_rate = sample_rate;
-    frame_resample->channels = channels;
-    frame_resample->format = AV_SAMPLE_FMT_FLT;
-
-    AVPacket *packet = av_packet_alloc();
-
-    // 重采样转换音频格式
-    SwrContext *swr_ctx = swr_alloc_set_opts(NULL,              // we're allocating a new context
-                                             layout,            // out_ch_layout
-                                             AV_SAMPLE_FMT_FLT, // out_sample_fmt
-                                             sample_rate,       // out_sample_rate
-                                             layout,            // in_ch_layout
-                                             format,            // in_sample_fmt
-                                             sample_rate,       // in_sample_rate
-                                             0,                 // log_offset
-                                             NULL);             // log_ctx
-
-    struct SwsContext *sws_ctx = sws_getContext(width,              // the width of the source image
-                                                height,             // the height of the source image
-                                                pix_fmt,            // the source image format
-                                                width,              // the width of the destination image
-                                                height,             // the height of the destination image
-                                                AV_PIX_FMT_YUV420P, // the destination image format
-                                                SWS_BILINEAR,       // algorithm and options
-                                                NULL,               // the filter of the source image
-                                                NULL,               // the filter of the source image
-                                                NULL                // extra parameters to tune the used scaler
-    );
-    int buffer_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 32);
-    uint8_t *buffer = av_malloc(sizeof(uint8_t) * buffer_size);
-    av_image_fill_arrays(frame_scale->data, frame_scale->linesize, buffer, AV_PIX_FMT_YUV420P, width, height, 32);
-
-    while (av_read_frame(fmt_ctx, packet) == 0) {
-        // 只要音频
-        if (packet->stream_index == audio_stream_index) {
-            // 把 packet 中的数据传给解码器进行解码
-            ret = avcodec_send_packet(audio_codec_ctx, packet);
-            if (ret < 0) {
-                printf("Error decoding\n");
-                return -1;
-            }
-
-            // packet 里可能有多个完整的 frame
-            while (1) {
-                ret = avcodec_receive_frame(audio_codec_ctx, frame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                } else if (ret < 0) {
-                    printf("Error decoding\n");
-                    return -1;
-                }
+    // 只在这里协商一次：重采样直接输出设备实际的采样率、格式和声道，SDL 不用在后面再转换一次
+    SDL_AudioSpec audio_spec;
+    audio_device = open_audio_device(sample_rate, channels, &audio_spec);
+    enum AVSampleFormat out_sample_fmt = sdl_audio_sample_fmt(audio_spec.format);
+    printf("audio device: %d Hz, %d channels, %s, %d samples per callback\n", audio_spec.freq, audio_spec.channels,
+           av_get_sample_fmt_name(out_sample_fmt), audio_spec.samples);
+
+    PlayerState ps = {
+        .fmt_ctx = fmt_ctx,
+        .video_stream_index = source.video_index,
+        .audio_stream_index = source.audio_index,
+        .video_decoder = &video_decoder,
+        .audio_decoder = &audio_decoder,
+        .width = width,
+        .height = height,
+        .out_pix_fmt = out_pix_fmt,
+        .audio_time_base = audio_stream->time_base,
+        .out_layout = sdl_audio_channel_layout(audio_spec.channels),
+        .out_sample_fmt = out_sample_fmt,
+        .out_sample_rate = audio_spec.freq,
+    };
+    atomic_init(&ps.quit, 0);
+    atomic_init(&ps.seek_target, 0);
+    atomic_init(&ps.seek_request, 0);
+    atomic_init(&ps.seek_done, 0);
+    atomic_init(&ps.serial, 0);
+    atomic_init(&ps.audio_eof_serial, -1);
+    atomic_init(&ps.video_eof_serial, -1);
+    ps.seek_index = seek_index_open(filename);
+    if (ps.seek_index != NULL) {
+        printf("Using seek index %s.idx\n", filename);
+    }
+    demux_stats_init(&ps.demux_stats);
+    int bytes_per_second = audio_spec.freq * audio_spec.channels * av_get_bytes_per_sample(out_sample_fmt);
+    // 设备每次回调取走 audio_spec.samples 个采样
+    av_sync_init(&ps.sync, bytes_per_second, (double)audio_spec.samples / audio_spec.freq);
+    ps.sync_mutex = SDL_CreateMutex();
+    ps.demux_mutex = SDL_CreateMutex();
+    ps.demux_cond = SDL_CreateCond();
+    if (audio_ring_init(&audio_ring, bytes_per_second * audio_latency_ms / 1000, AUDIO_MAX_CHUNK) < 0) {
+        printf("Could not allocate audio buffer\n");
+        return -1;
+    }
+    volume_init(&volume, audio_spec.freq, audio_spec.channels, out_sample_fmt);
+    // 缓冲区准备好以后再开始播放，回调一开始就能安全地读
+    SDL_PauseAudioDevice(audio_device, 0);
+    queue_init(&ps.video_packets, packet_queue_count, packet_queue_bytes);
+    queue_init(&ps.audio_packets, packet_queue_count, packet_queue_bytes);
+    queue_init(&ps.video_frames, frame_queue_count, frame_queue_bytes);
+    // 两个 packet 队列加上解复用和解码线程手里的，frame 队列加上解码和渲染手里的
+    // 开始播放前全部分配好，播放过程中 packet 和 frame 都从池里循环使用
+    if (packet_pool_init(&ps.packet_pool, packet_queue_count * 2 + 4) < 0 ||
+        frame_pool_init(&ps.frame_pool, frame_queue_count + 2) < 0) {
+        printf("Could not allocate packet and frame pools\n");
+        return -1;
+    }
 
-                // 转换音频格式
-                ret = swr_convert_frame(swr_ctx, frame_resample, frame);
-                if (ret < 0) {
-                    printf("Resample error\n");
-                    return -1;
-                }
+    SDL_Thread *demux_tid = SDL_CreateThread(demux_thread, "demux", &ps);
+    SDL_Thread *audio_tid = SDL_CreateThread(audio_decode_thread, "audio_decode", &ps);
+    SDL_Thread *video_tid = SDL_CreateThread(video_decode_thread, "video_decode", &ps);
 
-                int frame_size = frame_resample->nb_samples * frame_resample->channels *
-                                 av_get_bytes_per_sample(frame_resample->format);
-                // printf("frame sample %d, %d\n", frame->linesize[0], frame_size);
-                SDL_QueueAudio(audio_device, frame_resample->data[0], frame_size);
-                // 释放 packet 内部数据，并把 packet 一些自动设为默认值
-                av_packet_unref(packet);
+    // 每帧的时长，视频超前超过一帧时重复显示上一帧
+    double frame_duration = 0.04;
+    if (video_stream->r_frame_rate.num > 0 && video_stream->r_frame_rate.den > 0) {
+        frame_duration = 1 / av_q2d(video_stream->r_frame_rate);
+    }
+    int frame_shown = 0;
+    double last_present = 0;
+    // 当前显示的帧的 serial 和时间，seek 按这个位置计算目标
+    int shown_serial = 0;
+    double position = 0;
+    int64_t start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+    // 按键时的时间和显示的帧的 serial，serial 变了说明新位置的第一帧显示出来了，打印 seek 延迟
+    double seek_start = -1;
+    int seek_serial = 0;
+
+    // 主线程负责渲染和处理事件，SDL 要求渲染在创建窗口的线程里进行
+    while (!atomic_load(&ps.quit) && !playback_finished(&ps)) {
+        AVFrame *frame_scale = queue_peek(&ps.video_frames);
+        if (frame_scale == NULL) {
+            // 还没有解码好的帧，睡到解码线程放入新帧，最多等一会就回来处理事件
+            queue_wait(&ps.video_frames, AV_SYNC_MAX_WAIT * 1000);
+        } else if ((int)(intptr_t)frame_scale->opaque != atomic_load(&ps.serial)) {
+            // seek 之前解码的帧
+            queue_try_pop(&ps.video_frames);
+            frame_pool_put(&ps.frame_pool, &frame_scale);
+        } else {
+            int serial = (int)(intptr_t)frame_scale->opaque;
+            if (serial != shown_serial) {
+                // seek 后的第一帧，视频不能再和 seek 之前的时间比较
+                SDL_LockMutex(ps.sync_mutex);
+                av_sync_video_flush(&ps.sync);
+                SDL_UnlockMutex(ps.sync_mutex);
+                shown_serial = serial;
             }
-        } else if (packet->stream_index == video_stream_index) {
-            // 把 packet 中的数据传给解码器进行解码
-            // 把 packet 中的数据传给解码器进行解码
-            ret = avcodec_send_packet(video_codec_ctx, packet);
-            if (ret < 0) {
-                printf("Error decoding\n");
-                return -1;
+            int action = AV_SYNC_SHOW;
+            double wait = 0;
+            if (frame_scale->pts != AV_NOPTS_VALUE) {
+                SDL_LockMutex(ps.sync_mutex);
+                double clock =
+                    av_sync_clock(&ps.sync, audio_ring_buffered(&audio_ring), audio_ring_since_fill(&audio_ring));
+                SDL_UnlockMutex(ps.sync_mutex);
+                double pts = frame_scale->pts * av_q2d(video_stream->time_base);
+                action = av_sync_video(&ps.sync, pts, clock, queue_count(&ps.video_frames) > 1, &wait);
             }
 
-            // packet 里可能有多个完整的 frame
-            while (1) {
-                ret = avcodec_receive_frame(video_codec_ctx, frame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                } else if (ret < 0) {
-                    printf("Error decoding\n");
-                    return -1;
+            if (action == AV_SYNC_DROP) {
+                // 已经来不及显示了
+                queue_try_pop(&ps.video_frames);
+                frame_pool_put(&ps.frame_pool, &frame_scale);
+            } else if (action == AV_SYNC_WAIT) {
+                // 下一帧还早，超过一帧的时间没有刷新就把上一帧再显示一次
+                if (frame_shown && wait > frame_duration && av_sync_now() - last_present >= frame_duration) {
+                    SDL_RenderClear(renderer);
+                    SDL_RenderCopy(renderer, texture, NULL, NULL);
+                    SDL_RenderPresent(renderer);
+                    last_present = av_sync_now();
+                    av_sync_duplicated(&ps.sync);
                 }
-
-                sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, height, frame_scale->data,
-                          frame_scale->linesize);
-                double fps = av_q2d(video_stream->r_frame_rate);
-                double sleep_time = 1 / fps;
-                // SDL_Delay(1000 * sleep_time);
-                SDL_Rect rect;
-                rect.x = 0;
-                rect.y = 0;
-                rect.w = width;
-                rect.h = height;
-                SDL_UpdateYUVTexture(texture, &rect, frame_scale->data[0], frame_scale->linesize[0],
-                                     frame_scale->data[1], frame_scale->linesize[1], frame_scale->data[2],
-                                     frame_scale->linesize[2]);
+                av_sync_sleep(FFMIN(wait, AV_SYNC_MAX_WAIT));
+            } else {
+                queue_try_pop(&ps.video_frames);
+                if (frame_scale->pts != AV_NOPTS_VALUE) {
+                    position = frame_scale->pts * av_q2d(video_stream->time_base);
+                }
+                sdl_upload_frame(texture, frame_scale);
+                frame_pool_put(&ps.frame_pool, &frame_scale);
                 // clear the current rendering target with the drawing color
                 SDL_RenderClear(renderer);
 
@@ -267,37 +780,113 @@ main(int argc, char const *argv[]) {
 
                 // update the screen with any rendering performed since the previous call
                 SDL_RenderPresent(renderer);
+                last_present = av_sync_now();
+                frame_shown = 1;
+                startup_timer_first_frame(&startup);
+                if (seek_start >= 0 && shown_serial != seek_serial) {
+                    printf("seek to %.2fs: %.1fms\n", position, (av_sync_now() - seek_start) * 1000);
+                    seek_start = -1;
+                }
             }
         }
 
         // handle event
         SDL_Event event;
-        SDL_PollEvent(&event);
-        switch (event.type) {
-        case SDL_QUIT: {
-            printf("quit event\n");
-            SDL_Quit();
-            exit(0);
-        } break;
-
-        default: {
-            // nothing to do
-        } break;
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT: {
+                printf("quit event\n");
+                atomic_store(&ps.quit, 1);
+            } break;
+
+            case SDL_KEYDOWN: {
+                SDL_Keycode key = event.key.keysym.sym;
+                // + - 调音量，m 静音
+                if (key == SDLK_EQUALS || key == SDLK_PLUS || key == SDLK_KP_PLUS) {
+                    printf("volume %d\n", volume_change(&volume, VOLUME_STEP));
+                    break;
+                } else if (key == SDLK_MINUS || key == SDLK_KP_MINUS) {
+                    printf("volume %d\n", volume_change(&volume, -VOLUME_STEP));
+                    break;
+                } else if (key == SDLK_m) {
+                    printf("%s\n", volume_toggle_mute(&volume) ? "muted" : "unmuted");
+                    break;
+                }
+                // 方向键前后跳，数字键跳到总时长的百分比
+                double target;
+                if (key == SDLK_LEFT) {
+                    target = position - SEEK_SHORT;
+                } else if (key == SDLK_RIGHT) {
+                    target = position + SEEK_SHORT;
+                } else if (key == SDLK_DOWN) {
+                    target = position - SEEK_LONG;
+                } else if (key == SDLK_UP) {
+                    target = position + SEEK_LONG;
+                } else if (key >= SDLK_0 && key <= SDLK_9 && fmt_ctx->duration > 0) {
+                    target = (start_time + fmt_ctx->duration * (key - SDLK_0) / 10) / (double)AV_TIME_BASE;
+                } else {
+                    break;
+                }
+                int64_t target_us = (int64_t)(target * AV_TIME_BASE);
+                target_us = FFMAX(target_us, start_time);
+                if (fmt_ctx->duration > 0) {
+                    target_us = FFMIN(target_us, start_time + fmt_ctx->duration);
+                }
+                // 先写目标再设置请求，解复用线程看到请求时目标一定是新的
+                atomic_store(&ps.seek_target, target_us);
+                atomic_fetch_add(&ps.seek_request, 1);
+                wake_demux(&ps);
+                seek_start = av_sync_now();
+                seek_serial = shown_serial;
+            } break;
+
+            default: {
+                // nothing to do
+            } break;
+            }
         }
     }
-    // printf("wav length: %d\n", wav_length);
-    // save_wave("sound1.wav", wav_buf, wav_length, sample_rate, channels, 32);
-    // 等待队列的音频播放完
-    while (SDL_GetQueuedAudioSize(audio_device) > 0) {
+
+    // 解复用和解码线程到了文件末尾也不退出，播完或者用户退出都要通知它们结束，取消所有队列让阻塞在队列上的线程返回
+    int finished = !atomic_load(&ps.quit);
+    atomic_store(&ps.quit, 1);
+    wake_demux(&ps);
+    audio_ring_wake(&audio_ring);
+    queue_abort(&ps.video_packets);
+    queue_abort(&ps.audio_packets);
+    queue_abort(&ps.video_frames);
+    SDL_WaitThread(demux_tid, NULL);
+    SDL_WaitThread(video_tid, NULL);
+    SDL_WaitThread(audio_tid, NULL);
+
+    // 正常播完时等待缓冲区的音频播放完
+    while (finished && audio_ring_buffered(&audio_ring) > 0) {
         SDL_Delay(100);
     }
+    // 先关掉设备，回调不会再读缓冲区
+    SDL_CloseAudioDevice(audio_device);
+
+    av_sync_print_stats(&ps.sync);
+    demux_stats_print(&ps.demux_stats, fmt_ctx);
+    audio_ring_print_stats(&audio_ring);
+    packet_pool_print_stats(&ps.packet_pool, "packet");
+    frame_pool_print_stats(&ps.frame_pool, "frame");
 
     // 清理分配的资源
-    av_frame_free(&frame);
-    av_frame_free(&frame_resample);
-    av_packet_free(&packet);
-    avcodec_close(audio_codec_ctx);
-    avformat_close_input(&fmt_ctx);
+    free_packet_queue(&ps.video_packets, &ps.packet_pool);
+    free_packet_queue(&ps.audio_packets, &ps.packet_pool);
+    free_frame_queue(&ps.video_frames, &ps.frame_pool);
+    packet_pool_destroy(&ps.packet_pool);
+    frame_pool_destroy(&ps.frame_pool);
+    audio_ring_destroy(&audio_ring);
+    SDL_DestroyMutex(ps.sync_mutex);
+    SDL_DestroyMutex(ps.demux_mutex);
+    SDL_DestroyCond(ps.demux_cond);
+    decoder_close(&video_decoder);
+    decoder_close(&audio_decoder);
+    seek_index_close(&ps.seek_index);
+    file_io_print_stats(source.io);
+    media_source_close(&source);
 
     // 清理 sdl 资源
     SDL_Quit();
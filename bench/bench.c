@@ -0,0 +1,471 @@
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/convert.h"
+#include "../common/decoder.h"
+#include "../common/demux.h"
+#include "../common/file_io.h"
+#include "../common/sdl_audio.h"
+#include "../common/sdl_video.h"
+
+// 不打开窗口和声卡，跑一遍和 4/2.c 相同的 解复用 -> 解码 -> 转换 -> 输出 流程
+// 统计每个阶段每次调用的耗时，最后输出 json，用来对比性能和评估机器配置
+//
+// 用法: bench <file> [--json=PATH] [--no-video] [--no-audio] [--audio-rate=N] [--threads=N] [--thread-type=...]
+// json 默认写到标准输出，其他日志都改到标准错误
+// 视频和播放器一样转换成 sdl_upload_pix_fmt 选的纹理格式，音频转换成交错的 float，采样率默认和播放器请求的一样
+// 用源采样率，声卡实际用别的采样率时用 --audio-rate 指定
+
+// 一个阶段的全部耗时样本，单位纳秒
+typedef struct StageStats {
+    int64_t *samples;
+    size_t count;
+    size_t capacity;
+    int64_t total;
+} StageStats;
+
+// 一路流的解码状态和统计
+typedef struct BenchStream {
+    int index;
+    AVCodecContext *codec_ctx;
+    int64_t frames;
+    // send_packet 的耗时算到下一个解码出来的帧上
+    int64_t pending_decode;
+    StageStats decode;
+    StageStats convert;
+    StageStats output;
+} BenchStream;
+
+typedef struct Bench {
+    BenchStream video;
+    BenchStream audio;
+    StageStats read;
+    DemuxStats demux_stats;
+
+    AVFrame *frame;
+    AVFrame *frame_out;
+    VideoConverter video_conv;
+    AudioConverter audio_conv;
+    // 模拟上传纹理和写声卡，把转换后的数据拷贝到这里
+    uint8_t *staging;
+    size_t staging_size;
+} Bench;
+
+int64_t
+now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+stage_add(StageStats *s, int64_t ns) {
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity > 0 ? s->capacity * 2 : 4096;
+        int64_t *samples = realloc(s->samples, capacity * sizeof(int64_t));
+        if (samples == NULL) {
+            return;
+        }
+        s->samples = samples;
+        s->capacity = capacity;
+    }
+    s->samples[s->count] = ns;
+    s->count += 1;
+    s->total += ns;
+}
+
+int
+compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// 排序后按位置取百分位数
+double
+stage_percentile_us(const StageStats *s, double p) {
+    if (s->count == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(p * (s->count - 1) + 0.5);
+    return s->samples[i] / 1000.0;
+}
+
+void
+stage_print_json(FILE *f, const char *name, StageStats *s) {
+    qsort(s->samples, s->count, sizeof(int64_t), compare_int64);
+    fprintf(f, "\"%s\": {\"count\": %zu, \"total_ms\": %.3f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}",
+            name, s->count, s->total / 1e6, stage_percentile_us(s, 0.5), stage_percentile_us(s, 0.99),
+            s->count > 0 ? s->samples[s->count - 1] / 1000.0 : 0);
+}
+
+void
+stage_free(StageStats *s) {
+    free(s->samples);
+    s->samples = NULL;
+}
+
+void
+json_print_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (const char *p = str; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if ((unsigned char)*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// 线程数是解码器实际用的，--threads=0 时是 ffmpeg 按 cpu 自动选的数量
+void
+stream_print_json(FILE *f, const char *name, BenchStream *s, const char *out_format) {
+    fprintf(f, "    \"%s\": {\"frames\": %lld, \"threads\": %d, \"out_format\": \"%s\",\n      ", name,
+            (long long)s->frames, s->codec_ctx->thread_count, out_format);
+    stage_print_json(f, "decode", &s->decode);
+    fprintf(f, ",\n      ");
+    stage_print_json(f, "convert", &s->convert);
+    fprintf(f, ",\n      ");
+    stage_print_json(f, "output", &s->output);
+    fprintf(f, "}");
+}
+
+// 把数据拷贝到 staging，大小不够时扩大
+int
+output_copy(Bench *b, const uint8_t *data, size_t size, size_t offset) {
+    if (offset + size > b->staging_size) {
+        uint8_t *staging = realloc(b->staging, offset + size);
+        if (staging == NULL) {
+            return -1;
+        }
+        b->staging = staging;
+        b->staging_size = offset + size;
+    }
+    memcpy(b->staging + offset, data, size);
+    return 0;
+}
+
+// 和播放器一样转换成纹理格式，解码器输出的格式能直接上传时不转换，然后逐行拷贝模拟上传纹理
+int
+process_video(Bench *b, AVFrame *frame) {
+    int64_t t0 = now_ns();
+    AVFrame *out = frame;
+    if (!video_converter_passthrough(&b->video_conv, frame)) {
+        out = b->frame_out;
+        if (video_converter_convert(&b->video_conv, frame, out) < 0) {
+            return -1;
+        }
+    }
+    int64_t t1 = now_ns();
+    stage_add(&b->video.convert, t1 - t0);
+
+    // yuv420p 是三个平面，nv12 是两个，色度平面的行数按格式缩小
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(out->format);
+    int widths[4];
+    if (av_image_fill_linesizes(widths, out->format, out->width) < 0) {
+        av_frame_unref(b->frame_out);
+        return -1;
+    }
+    size_t offset = 0;
+    for (int plane = 0; plane < 4 && out->data[plane] != NULL; plane++) {
+        int h = plane == 1 || plane == 2 ? AV_CEIL_RSHIFT(out->height, desc->log2_chroma_h) : out->height;
+        for (int y = 0; y < h; y++) {
+            if (output_copy(b, out->data[plane] + y * out->linesize[plane], widths[plane], offset) < 0) {
+                av_frame_unref(b->frame_out);
+                return -1;
+            }
+            offset += widths[plane];
+        }
+    }
+    av_frame_unref(b->frame_out);
+    stage_add(&b->video.output, now_ns() - t1);
+    return 0;
+}
+
+// 记录从 t0 开始的转换耗时，再把转换后的采样拷贝模拟写给声卡
+int
+output_audio(Bench *b, const uint8_t *data, int samples, int64_t t0) {
+    int64_t t1 = now_ns();
+    stage_add(&b->audio.convert, t1 - t0);
+    size_t size = (size_t)samples * b->audio_conv.channels * av_get_bytes_per_sample(b->audio_conv.format);
+    int ret = output_copy(b, data, size, 0);
+    stage_add(&b->audio.output, now_ns() - t1);
+    return ret;
+}
+
+// 和播放器一样用 audio_converter_convert_buffer 转换，格式相同时走 common/pcm.c 的直接转换，不经过 swresample
+int
+process_audio(Bench *b, AVFrame *frame) {
+    int64_t t0 = now_ns();
+    uint8_t *data = NULL;
+    int samples = audio_converter_convert_buffer(&b->audio_conv, frame, &data);
+    if (samples < 0) {
+        return -1;
+    }
+    return output_audio(b, data, samples, t0);
+}
+
+// 解码结束后取出重采样器里剩下的采样
+int
+drain_audio(Bench *b) {
+    int64_t t0 = now_ns();
+    uint8_t *data = NULL;
+    int samples = audio_converter_drain(&b->audio_conv, &data);
+    if (samples <= 0) {
+        return samples;
+    }
+    return output_audio(b, data, samples, t0);
+}
+
+// 把一个 packet 送进解码器，取出全部的帧处理，packet 为 NULL 时清空解码器
+int
+decode_packet(Bench *b, BenchStream *s, AVPacket *packet) {
+    int64_t t0 = now_ns();
+    int ret = avcodec_send_packet(s->codec_ctx, packet);
+    s->pending_decode += now_ns() - t0;
+    if (ret < 0) {
+        return ret;
+    }
+
+    while (1) {
+        t0 = now_ns();
+        ret = avcodec_receive_frame(s->codec_ctx, b->frame);
+        int64_t elapsed = now_ns() - t0;
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            s->pending_decode += elapsed;
+            return 0;
+        } else if (ret < 0) {
+            return ret;
+        }
+
+        stage_add(&s->decode, s->pending_decode + elapsed);
+        s->pending_decode = 0;
+        s->frames += 1;
+        ret = s == &b->video ? process_video(b, b->frame) : process_audio(b, b->frame);
+        av_frame_unref(b->frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+int
+open_stream(AVFormatContext *fmt_ctx, enum AVMediaType type, const DecoderOptions *opts, BenchStream *s) {
+    s->index = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
+    if (s->index < 0) {
+        return 0;
+    }
+    int ret = open_decoder(fmt_ctx, s->index, opts, &s->codec_ctx);
+    if (ret < 0) {
+        printf("Could not open %s decoder\n", av_get_media_type_string(type));
+        s->index = -1;
+        return ret;
+    }
+    return 0;
+}
+
+int
+main(int argc, char const *argv[]) {
+    StartupTimer startup;
+    startup_timer_init(&startup);
+    DecoderOptions decoder_opts;
+    argc = decoder_parse_args(&decoder_opts, argc, argv);
+    ProbeOptions probe_opts;
+    argc = probe_parse_args(&probe_opts, argc, argv);
+    FileIOOptions io_opts;
+    argc = file_io_parse_args(&io_opts, argc, argv);
+    const char *filename = NULL;
+    const char *json_path = NULL;
+    int use_video = 1;
+    int use_audio = 1;
+    int audio_rate = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if (strcmp(argv[i], "--no-video") == 0) {
+            use_video = 0;
+        } else if (strcmp(argv[i], "--no-audio") == 0) {
+            use_audio = 0;
+        } else if (strncmp(argv[i], "--audio-rate=", 13) == 0) {
+            audio_rate = atoi(argv[i] + 13);
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (filename == NULL) {
+        printf("Usage: %s <file> [--json=PATH] [--no-video] [--no-audio] [--audio-rate=N]\n", argv[0]);
+        return -1;
+    }
+
+    // json 写到原来的标准输出，公共代码里的日志都转到标准错误，不会混进 json
+    FILE *json = NULL;
+    if (json_path != NULL) {
+        json = fopen(json_path, "w");
+    } else {
+        json = fdopen(dup(STDOUT_FILENO), "w");
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    if (json == NULL) {
+        printf("Could not open json output\n");
+        return -1;
+    }
+
+    int64_t start = now_ns();
+    AVFormatContext *fmt_ctx = NULL;
+    FileIO *file_io = NULL;
+    int ret = file_io_open_input(&fmt_ctx, filename, &io_opts, &file_io);
+    if (ret < 0) {
+        printf("Could not open file %s\n", filename);
+        return -1;
+    }
+    int want = (use_video ? DEMUX_WANT_VIDEO : 0) | (use_audio ? DEMUX_WANT_AUDIO : 0);
+    ret = demux_find_stream_info(fmt_ctx, filename, &probe_opts, want, &startup);
+    if (ret < 0) {
+        printf("Could not find stream info %s\n", filename);
+        return -1;
+    }
+
+    Bench b = {0};
+    b.video.index = -1;
+    b.audio.index = -1;
+    if ((use_video && open_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, &decoder_opts, &b.video) < 0) ||
+        (use_audio && open_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, &decoder_opts, &b.audio) < 0)) {
+        return -1;
+    }
+    if (b.video.index < 0 && b.audio.index < 0) {
+        printf("Could not find any stream to decode\n");
+        return -1;
+    }
+    if (b.video.index >= 0) {
+        AVCodecContext *ctx = b.video.codec_ctx;
+        if (video_converter_init(&b.video_conv, ctx->width, ctx->height, sdl_upload_pix_fmt(ctx->pix_fmt),
+                                 SWS_BILINEAR) < 0) {
+            printf("Could not create video converter\n");
+            return -1;
+        }
+    }
+    if (b.audio.index >= 0) {
+        AVCodecContext *ctx = b.audio.codec_ctx;
+        audio_converter_init(&b.audio_conv, sdl_audio_channel_layout(ctx->channels), AV_SAMPLE_FMT_FLT,
+                             audio_rate > 0 ? audio_rate : ctx->sample_rate);
+    }
+    // 只解复用要测的流
+    demux_keep_streams(fmt_ctx, b.video.index, b.audio.index);
+    demux_stats_init(&b.demux_stats);
+    b.frame = av_frame_alloc();
+    b.frame_out = av_frame_alloc();
+
+    AVPacket *packet = av_packet_alloc();
+    int64_t decode_start = now_ns();
+    while (1) {
+        int64_t t0 = now_ns();
+        ret = av_read_frame(fmt_ctx, packet);
+        stage_add(&b.read, now_ns() - t0);
+        if (ret < 0) {
+            break;
+        }
+
+        BenchStream *s = NULL;
+        if (packet->stream_index == b.video.index) {
+            s = &b.video;
+        } else if (packet->stream_index == b.audio.index) {
+            s = &b.audio;
+        }
+        demux_stats_packet(&b.demux_stats, packet, s != NULL);
+        if (s != NULL && decode_packet(&b, s, packet) < 0) {
+            printf("Error decoding stream %d\n", packet->stream_index);
+        }
+        if (b.video.frames + b.audio.frames > 0) {
+            startup_timer_first_frame(&startup);
+        }
+        av_packet_unref(packet);
+    }
+    // 文件读完后取出解码器里缓存的帧
+    if (b.video.index >= 0) {
+        decode_packet(&b, &b.video, NULL);
+    }
+    if (b.audio.index >= 0) {
+        decode_packet(&b, &b.audio, NULL);
+        drain_audio(&b);
+    }
+    int64_t end = now_ns();
+
+    double seconds = (end - decode_start) / 1e9;
+    int64_t frames = b.video.index >= 0 ? b.video.frames : b.audio.frames;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(json, "{\n  \"file\": ");
+    json_print_string(json, filename);
+    fprintf(json, ",\n");
+    fprintf(json, "  \"open_seconds\": %.6f,\n", (decode_start - start) / 1e9);
+    fprintf(json, "  \"startup\": {\"open_ms\": %.3f, \"stream_info_ms\": %.3f, \"first_frame_ms\": %.3f},\n",
+            (startup.opened - startup.start) / 1000.0, (startup.probed - startup.opened) / 1000.0,
+            startup.first_frame > 0 ? (startup.first_frame - startup.start) / 1000.0 : 0);
+    fprintf(json, "  \"decode_seconds\": %.6f,\n", seconds);
+    fprintf(json, "  \"fps\": %.2f,\n", seconds > 0 ? frames / seconds : 0);
+    const char *io_modes[] = {"default", "mmap", "readahead"};
+    fprintf(json, "  \"io\": {\"mode\": \"%s\"", io_modes[io_opts.mode]);
+    if (file_io != NULL) {
+        fprintf(json, ", \"read_calls\": %lld, \"seek_calls\": %lld, \"advise_calls\": %lld, \"bytes\": %lld",
+                (long long)file_io->stats.read_calls, (long long)file_io->stats.seek_calls,
+                (long long)file_io->stats.advise_calls, (long long)file_io->stats.bytes);
+    }
+    fprintf(json, "},\n");
+    fprintf(json, "  \"packets\": %lld,\n", (long long)b.demux_stats.packets);
+    fprintf(json, "  \"file_bytes_read\": %lld,\n", (long long)(fmt_ctx->pb != NULL ? fmt_ctx->pb->bytes_read : 0));
+    fprintf(json, "  \"packet_bytes\": %lld,\n", (long long)b.demux_stats.packet_bytes);
+    fprintf(json, "  \"used_bytes\": %lld,\n", (long long)b.demux_stats.used_bytes);
+    // linux 上 ru_maxrss 的单位是 KB
+    fprintf(json, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    fprintf(json, "  \"stages\": {\n    ");
+    stage_print_json(json, "read", &b.read);
+    if (b.video.index >= 0) {
+        fprintf(json, ",\n");
+        stream_print_json(json, "video", &b.video, av_get_pix_fmt_name(b.video_conv.format));
+    }
+    if (b.audio.index >= 0) {
+        fprintf(json, ",\n");
+        char audio_format[64];
+        snprintf(audio_format, sizeof(audio_format), "%s %d Hz", av_get_sample_fmt_name(b.audio_conv.format),
+                 b.audio_conv.sample_rate);
+        stream_print_json(json, "audio", &b.audio, audio_format);
+    }
+    fprintf(json, "\n  }\n}\n");
+    fclose(json);
+
+    // 清理分配的资源
+    stage_free(&b.read);
+    BenchStream *streams[] = {&b.video, &b.audio};
+    for (int i = 0; i < 2; i++) {
+        stage_free(&streams[i]->decode);
+        stage_free(&streams[i]->convert);
+        stage_free(&streams[i]->output);
+        avcodec_free_context(&streams[i]->codec_ctx);
+    }
+    video_converter_free(&b.video_conv);
+    audio_converter_free(&b.audio_conv);
+    free(b.staging);
+    av_frame_free(&b.frame);
+    av_frame_free(&b.frame_out);
+    av_packet_free(&packet);
+    avformat_close_input(&fmt_ctx);
+    file_io_close(&file_io);
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <libavutil/channel_layout.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+#include <libswresample/swresample.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/pcm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// 对比 common/pcm.c 的转换函数和 swresample 在采样率、声道布局不变时的速度
+// 每种转换跑 frames 帧双声道音频，取几轮里最快的一轮，打印每个采样（每个声道的每个点）的纳秒数和 cpu 周期数
+// 周期数用 rdtsc 读，是按 cpu 标称频率算的，睿频时和实际周期有出入，只能用来横向对比
+//
+// 用法: pcm_bench [samples per frame] [frames]
+
+#define CHANNELS 2
+#define ROUNDS 5
+
+typedef struct PcmBench {
+    int samples;
+    int frames;
+    float *planes[CHANNELS];
+    int16_t *s16;
+    float *out;
+    SwrContext *swr_fltp;
+    SwrContext *swr_s16;
+} PcmBench;
+
+typedef void (*PcmBenchFn)(PcmBench *b);
+
+int64_t
+now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t
+now_cycles(void) {
+#if defined(HAVE_RDTSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void
+fltp_swr(PcmBench *b) {
+    uint8_t *out = (uint8_t *)b->out;
+    swr_convert(b->swr_fltp, &out, b->samples, (const uint8_t **)b->planes, b->samples);
+}
+
+void
+fltp_c(PcmBench *b) {
+    for (int i = 0; i < b->samples; i++) {
+        for (int c = 0; c < CHANNELS; c++) {
+            b->out[i * CHANNELS + c] = b->planes[c][i];
+        }
+    }
+}
+
+void
+fltp_pcm(PcmBench *b) {
+    pcm_interleave_float(b->out, (const float *const *)b->planes, CHANNELS, b->samples);
+}
+
+void
+s16_swr(PcmBench *b) {
+    uint8_t *out = (uint8_t *)b->out;
+    const uint8_t *in = (const uint8_t *)b->s16;
+    swr_convert(b->swr_s16, &out, b->samples, &in, b->samples);
+}
+
+void
+s16_c(PcmBench *b) {
+    for (int i = 0; i < b->samples * CHANNELS; i++) {
+        b->out[i] = b->s16[i] * (1.0f / 32768);
+    }
+}
+
+void
+s16_pcm(PcmBench *b) {
+    pcm_s16_to_float(b->out, b->s16, b->samples * CHANNELS);
+}
+
+// 增益交替乘大于 1 和小于 1 的数，跑很多轮数值也不会溢出或者变成非规格化数
+void
+gain_c(PcmBench *b) {
+    static int flip;
+    float gain = (flip ^= 1) ? 1.25f : 0.8f;
+    for (int i = 0; i < b->samples * CHANNELS; i++) {
+        b->out[i] *= gain;
+    }
+}
+
+void
+gain_pcm(PcmBench *b) {
+    static int flip;
+    pcm_apply_gain(b->out, b->samples * CHANNELS, (flip ^= 1) ? 1.25f : 0.8f);
+}
+
+void
+run(PcmBench *b, const char *name, PcmBenchFn fn) {
+    int64_t best_ns = INT64_MAX;
+    uint64_t best_cycles = UINT64_MAX;
+    // 先跑一轮预热缓存和分支预测
+    for (int round = 0; round <= ROUNDS; round++) {
+        int64_t start = now_ns();
+        uint64_t start_cycles = now_cycles();
+        for (int i = 0; i < b->frames; i++) {
+            fn(b);
+        }
+        uint64_t cycles = now_cycles() - start_cycles;
+        int64_t ns = now_ns() - start;
+        if (round > 0 && ns < best_ns) {
+            best_ns = ns;
+            best_cycles = cycles;
+        }
+    }
+    double count = (double)b->samples * CHANNELS * b->frames;
+#if defined(HAVE_RDTSC)
+    printf("%-24s %8.3f ns/sample %8.3f cycles/sample\n", name, best_ns / count, best_cycles / count);
+#else
+    printf("%-24s %8.3f ns/sample\n", name, best_ns / count);
+#endif
+}
+
+// 转换函数按 cpu 支持选择实现，有 AVX2 时再关掉 AVX2 跑一遍，看 SSE2 版本的速度
+void
+run_pcm(PcmBench *b, const char *name, PcmBenchFn fn) {
+    char label[64];
+    snprintf(label, sizeof(label), "%s %s", name, pcm_simd_name());
+    run(b, label, fn);
+    if (strcmp(pcm_simd_name(), "avx2") == 0) {
+        av_force_cpu_flags(av_get_cpu_flags() & ~AV_CPU_FLAG_AVX2);
+        snprintf(label, sizeof(label), "%s %s", name, pcm_simd_name());
+        run(b, label, fn);
+        av_force_cpu_flags(-1);
+    }
+}
+
+SwrContext *
+open_swr(enum AVSampleFormat in_fmt) {
+    SwrContext *swr = swr_alloc_set_opts(NULL, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, 48000, AV_CH_LAYOUT_STEREO,
+                                         in_fmt, 48000, 0, NULL);
+    if (swr == NULL || swr_init(swr) < 0) {
+        swr_free(&swr);
+    }
+    return swr;
+}
+
+int
+main(int argc, char const *argv[]) {
+    PcmBench b = {
+        .samples = argc > 1 ? atoi(argv[1]) : 1024,
+        .frames = argc > 2 ? atoi(argv[2]) : 20000,
+    };
+    if (b.samples <= 0 || b.frames <= 0) {
+        printf("Usage: %s [samples per frame] [frames]\n", argv[0]);
+        return -1;
+    }
+    for (int c = 0; c < CHANNELS; c++) {
+        b.planes[c] = av_malloc(b.samples * sizeof(float));
+    }
+    b.s16 = av_malloc(b.samples * CHANNELS * sizeof(int16_t));
+    b.out = av_malloc(b.samples * CHANNELS * sizeof(float));
+    b.swr_fltp = open_swr(AV_SAMPLE_FMT_FLTP);
+    b.swr_s16 = open_swr(AV_SAMPLE_FMT_S16);
+    if (b.planes[0] == NULL || b.planes[1] == NULL || b.s16 == NULL || b.out == NULL || b.swr_fltp == NULL ||
+        b.swr_s16 == NULL) {
+        printf("Could not allocate buffers\n");
+        return -1;
+    }
+    srand(1);
+    for (int i = 0; i < b.samples; i++) {
+        for (int c = 0; c < CHANNELS; c++) {
+            b.planes[c][i] = rand() / (float)RAND_MAX * 2 - 1;
+            b.s16[i * CHANNELS + c] = (int16_t)(rand() % 65536 - 32768);
+        }
+    }
+
+    printf("%d samples x %d channels per frame, %d frames\n", b.samples, CHANNELS, b.frames);
+    run(&b, "fltp->flt swresample", fltp_swr);
+    run(&b, "fltp->flt c", fltp_c);
+    run_pcm(&b, "fltp->flt", fltp_pcm);
+    run(&b, "s16->flt swresample", s16_swr);
+    run(&b, "s16->flt c", s16_c);
+    run_pcm(&b, "s16->flt", s16_pcm);
+    run(&b, "gain c", gain_c);
+    run_pcm(&b, "gain", gain_pcm);
+
+    swr_free(&b.swr_fltp);
+    swr_free(&b.swr_s16);
+    for (int c = 0; c < CHANNELS; c++) {
+        av_free(b.planes[c]);
+    }
+    av_free(b.s16);
+    av_free(b.out);
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "audio_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t
+now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int
+audio_ring_init(AudioRing *r, size_t target, size_t max_chunk) {
+    size_t capacity = 4096;
+    while (capacity < target + max_chunk) {
+        capacity *= 2;
+    }
+    r->data = malloc(capacity);
+    if (r->data == NULL) {
+        return -1;
+    }
+    r->capacity = capacity;
+    r->target = target;
+    atomic_init(&r->write_pos, 0);
+    atomic_init(&r->read_pos, 0);
+    atomic_init(&r->underruns, 0);
+    atomic_init(&r->underrun_bytes, 0);
+    atomic_init(&r->fill_time, 0);
+    atomic_init(&r->waiting, 0);
+    if (sem_init(&r->wakeup, 0, 0) < 0) {
+        free(r->data);
+        r->data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void
+audio_ring_destroy(AudioRing *r) {
+    free(r->data);
+    r->data = NULL;
+    sem_destroy(&r->wakeup);
+}
+
+size_t
+audio_ring_buffered(AudioRing *r) {
+    uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+    uint64_t write_pos = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+    return write_pos - read_pos;
+}
+
+// 0 表示可以写了，1 表示还要等，-1 表示要退出
+static int
+wait_state(AudioRing *r, size_t size, atomic_int *quit) {
+    if (quit != NULL && atomic_load(quit)) {
+        return -1;
+    }
+    size_t buffered = audio_ring_buffered(r);
+    if (buffered + size <= r->capacity && (buffered < r->target || buffered == 0)) {
+        return 0;
+    }
+    return 1;
+}
+
+int
+audio_ring_wait(AudioRing *r, size_t size, atomic_int *quit) {
+    if (size > r->capacity) {
+        return -1;
+    }
+    while (1) {
+        int state = wait_state(r, size, quit);
+        if (state <= 0) {
+            return state;
+        }
+        // 先声明在等，再检查一次，回调在这之后取走数据一定会看到 waiting
+        atomic_store(&r->waiting, 1);
+        if (wait_state(r, size, quit) == 1 || atomic_exchange(&r->waiting, 0) == 0) {
+            // 还要等，或者回调已经看到 waiting 并且会 post，把这次 post 消耗掉，计数才对得上
+            while (sem_wait(&r->wakeup) < 0) {
+            }
+        }
+    }
+}
+
+void
+audio_ring_wake(AudioRing *r) {
+    if (atomic_load(&r->waiting) && atomic_exchange(&r->waiting, 0)) {
+        sem_post(&r->wakeup);
+    }
+}
+
+size_t
+audio_ring_write(AudioRing *r, const void *data, size_t size) {
+    uint64_t write_pos = atomic_load_explicit(&r->write_pos, memory_order_relaxed);
+    uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+    size_t space = r->capacity - (write_pos - read_pos);
+    if (size > space) {
+        size = space;
+    }
+
+    // 写到末尾后从头接着写，最多分两段拷贝
+    size_t offset = write_pos & (r->capacity - 1);
+    size_t first = r->capacity - offset < size ? r->capacity - offset : size;
+    memcpy(r->data + offset, data, first);
+    memcpy(r->data, (const uint8_t *)data + first, size - first);
+    atomic_store_explicit(&r->write_pos, write_pos + size, memory_order_release);
+    return size;
+}
+
+void
+audio_ring_clear(AudioRing *r) {
+    uint64_t write_pos = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+    atomic_store_explicit(&r->read_pos, write_pos, memory_order_release);
+}
+
+void
+audio_ring_fill(AudioRing *r, uint8_t *stream, size_t len) {
+    uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_relaxed);
+    uint64_t write_pos = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+    size_t size = write_pos - read_pos;
+    if (size > len) {
+        size = len;
+    }
+
+    size_t offset = read_pos & (r->capacity - 1);
+    size_t first = r->capacity - offset < size ? r->capacity - offset : size;
+    memcpy(stream, r->data + offset, first);
+    memcpy(stream + first, r->data, size - first);
+    atomic_store_explicit(&r->read_pos, read_pos + size, memory_order_release);
+    atomic_store_explicit(&r->fill_time, now_ns(), memory_order_release);
+    // 取走了数据，生产者在等就叫醒它，让它自己判断是否低于延迟目标
+    atomic_thread_fence(memory_order_seq_cst);
+    audio_ring_wake(r);
+
+    if (size < len) {
+        // 32 位浮点和有符号整数的静音都是 0
+        memset(stream + size, 0, len - size);
+        // 还没开始写数据之前的静音不算欠载
+        if (write_pos > 0) {
+            atomic_fetch_add(&r->underruns, 1);
+            atomic_fetch_add(&r->underrun_bytes, len - size);
+        }
+    }
+}
+
+double
+audio_ring_since_fill(AudioRing *r) {
+    uint64_t fill_time = atomic_load_explicit(&r->fill_time, memory_order_acquire);
+    if (fill_time == 0) {
+        return -1;
+    }
+    return (now_ns() - fill_time) / 1e9;
+}
+
+void
+audio_ring_print_stats(AudioRing *r) {
+    printf("audio ring: %zu bytes capacity, %zu bytes target, %llu underruns, %llu bytes of silence\n", r->capacity,
+           r->target, (unsigned long long)atomic_load(&r->underruns),
+           (unsigned long long)atomic_load(&r->underrun_bytes));
+}
@@ -0,0 +1,70 @@
+#ifndef COMMON_AUDIO_RING_H
+#define COMMON_AUDIO_RING_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 音频数据的无锁环形缓冲区，解码线程写入，SDL 音频回调读出（单生产者单消费者）
+// 缓冲区里最多保持 target 字节，也就是播放延迟的目标值
+typedef struct AudioRing {
+    uint8_t *data;
+    // 容量是 2 的幂，位置对容量取模可以用位运算
+    size_t capacity;
+    size_t target;
+    // 累计写入和读出的字节数，只增不减
+    atomic_ullong write_pos;
+    atomic_ullong read_pos;
+    // 回调要数据时缓冲区不够的次数和补静音的字节数
+    atomic_ullong underruns;
+    atomic_ullong underrun_bytes;
+    // 最近一次回调取数据的时间，单位纳秒，用来推算设备里的数据播到哪了
+    atomic_ullong fill_time;
+    // 生产者等待空间时把 waiting 设为 1 然后睡在 wakeup 上，回调取走数据后唤醒
+    // sem_post 不加锁，可以在音频回调里调用，没有线程在等时回调什么都不做
+    atomic_int waiting;
+    sem_t wakeup;
+} AudioRing;
+
+// target 是延迟目标（字节），max_chunk 是一次最多写入的字节数
+int
+audio_ring_init(AudioRing *r, size_t target, size_t max_chunk);
+
+void
+audio_ring_destroy(AudioRing *r);
+
+// 还没有播放的字节数
+size_t
+audio_ring_buffered(AudioRing *r);
+
+// 等到缓冲区低于延迟目标并且能放下 size 字节，quit 变成非 0 时返回 -1
+// 等待时睡眠，由回调取走数据或者 audio_ring_wake 唤醒
+int
+audio_ring_wait(AudioRing *r, size_t size, atomic_int *quit);
+
+// 唤醒 audio_ring_wait，修改 quit 之后调用
+void
+audio_ring_wake(AudioRing *r);
+
+// 写入数据，放不下的部分丢掉，返回写入的字节数，只能由生产者调用
+size_t
+audio_ring_write(AudioRing *r, const void *data, size_t size);
+
+// 丢掉还没有播放的数据，比如 seek 之后
+// 会修改读位置，调用时回调不能在运行（用 SDL_LockAudioDevice 挡住回调）
+void
+audio_ring_clear(AudioRing *r);
+
+// 给音频回调用，读出 len 字节到 stream，不够的部分补静音并记录一次欠载
+void
+audio_ring_fill(AudioRing *r, uint8_t *stream, size_t len);
+
+// 最近一次回调取数据到现在过了多少秒，回调还没有运行过返回负数
+double
+audio_ring_since_fill(AudioRing *r);
+
+void
+audio_ring_print_stats(AudioRing *r);
+
+#endif
@@ -0,0 +1,131 @@
+#include "av_sync.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+void
+av_sync_init(AVSync *s, int bytes_per_second, double device_latency) {
+    *s = (AVSync){0};
+    s->bytes_per_second = bytes_per_second;
+    s->device_latency = device_latency;
+    s->audio_idle_start = -1;
+}
+
+void
+av_sync_audio_written(AVSync *s, double pts, int bytes) {
+    double duration = (double)bytes / s->bytes_per_second;
+    // 没有 pts 的数据紧接着上一块
+    if (pts >= 0) {
+        s->audio_pts = pts + duration;
+    } else {
+        s->audio_pts += duration;
+    }
+    s->audio_started = 1;
+    s->audio_idle_start = -1;
+}
+
+void
+av_sync_audio_flush(AVSync *s) {
+    s->audio_pts = 0;
+    s->audio_started = 0;
+    s->audio_idle_start = -1;
+}
+
+void
+av_sync_video_flush(AVSync *s) {
+    s->external_started = 0;
+}
+
+double
+av_sync_clock(AVSync *s, int64_t pending_bytes, double since_fill) {
+    if (s->audio_started) {
+        // 回调取走的数据从取走的时刻开始播放，已经过去的时间不再算作延迟
+        double device_pending = s->device_latency;
+        if (since_fill >= 0) {
+            device_pending = since_fill < s->device_latency ? s->device_latency - since_fill : 0;
+        }
+        if (pending_bytes == 0) {
+            // 缓冲区空了，audio_pts 不会再增加，从取空的时刻开始按真实时间外推
+            double now = av_sync_now();
+            if (s->audio_idle_start < 0) {
+                s->audio_idle_start = now;
+                s->audio_idle_clock = s->audio_pts - device_pending;
+            }
+            return s->audio_idle_clock + now - s->audio_idle_start;
+        }
+        s->audio_idle_start = -1;
+        double pending = (double)pending_bytes / s->bytes_per_second + device_pending;
+        return s->audio_pts - pending;
+    }
+    if (s->external_started) {
+        return s->external_pts + av_sync_now() - s->external_start;
+    }
+    return NAN;
+}
+
+int
+av_sync_video(AVSync *s, double frame_pts, double clock, int has_next, double *wait) {
+    *wait = 0;
+    if (isnan(clock)) {
+        // 还没有任何时钟，用第一帧启动外部时钟
+        s->external_pts = frame_pts;
+        s->external_start = av_sync_now();
+        s->external_started = 1;
+        clock = frame_pts;
+    }
+
+    double diff = frame_pts - clock;
+    if (diff > AV_SYNC_SHOW_THRESHOLD) {
+        *wait = diff;
+        return AV_SYNC_WAIT;
+    }
+    if (diff < -AV_SYNC_DROP_THRESHOLD && has_next) {
+        s->frames_dropped += 1;
+        return AV_SYNC_DROP;
+    }
+
+    s->frames_shown += 1;
+    s->last_drift = diff;
+    s->total_drift += fabs(diff);
+    if (fabs(diff) > s->max_drift) {
+        s->max_drift = fabs(diff);
+    }
+    return AV_SYNC_SHOW;
+}
+
+void
+av_sync_duplicated(AVSync *s) {
+    s->frames_duplicated += 1;
+}
+
+void
+av_sync_sleep(double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+    // 用绝对时间睡眠，被信号打断后继续睡到同一个时间点
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int64_t ns = deadline.tv_nsec + (int64_t)(seconds * 1e9);
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+double
+av_sync_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void
+av_sync_print_stats(AVSync *s) {
+    double avg_drift = s->frames_shown > 0 ? s->total_drift / s->frames_shown : 0;
+    printf("sync: shown %lld, dropped %lld, duplicated %lld, drift last %.3fs avg %.3fs max %.3fs\n",
+           (long long)s->frames_shown, (long long)s->frames_dropped, (long long)s->frames_duplicated, s->last_drift,
+           avg_drift, s->max_drift);
+}
@@ -0,0 +1,91 @@
+#ifndef COMMON_AV_SYNC_H
+#define COMMON_AV_SYNC_H
+
+#include <stdint.h>
+
+// 视频比时钟晚这么多（秒）以上，并且后面还有帧可以显示，就丢掉这一帧
+#define AV_SYNC_DROP_THRESHOLD 0.04
+// 视频比时钟早这么多（秒）以内，直接显示，不再等待
+#define AV_SYNC_SHOW_THRESHOLD 0.002
+// 一次最多等待的时长（秒），等待期间主线程还要处理事件
+#define AV_SYNC_MAX_WAIT 0.01
+
+// 对一帧视频的处理方式
+enum {
+    AV_SYNC_SHOW,
+    AV_SYNC_DROP,
+    AV_SYNC_WAIT,
+};
+
+// 以音频为主时钟的音视频同步
+// 音频时钟 = 已经写进缓冲区的音频结束时的 pts - 缓冲区里还没取走的数据时长 - 设备里还没播完的数据时长
+// 缓冲区空了以后音频时钟不再变化，改成从取空时的值按真实时间外推
+typedef struct AVSync {
+    // 每秒的音频字节数，用来把设备里剩余的字节换算成时长
+    int bytes_per_second;
+    // 设备一次回调取走的数据时长，这部分数据已经不在缓冲区里但还没有播出来
+    double device_latency;
+    // 已经写进缓冲区的音频数据结束时的 pts，单位秒
+    double audio_pts;
+    int audio_started;
+    // 缓冲区取空的时刻和当时的音频时钟，不知道时 audio_idle_start 为负数
+    // 音频播完了（文件里音频比视频短）或者一直欠载时，时钟从这里按真实时间往前走，视频不会停住
+    double audio_idle_start;
+    double audio_idle_clock;
+
+    // 没有音频数据时使用的外部时钟
+    double external_pts;
+    double external_start;
+    int external_started;
+
+    // 统计
+    int64_t frames_shown;
+    int64_t frames_dropped;
+    int64_t frames_duplicated;
+    // 显示时视频 pts 与时钟的差值，正数表示视频超前
+    double last_drift;
+    double max_drift;
+    double total_drift;
+} AVSync;
+
+void
+av_sync_init(AVSync *s, int bytes_per_second, double device_latency);
+
+// 音频线程把数据写进缓冲区之后调用，pts 是这块数据开始的时间（秒），不知道时传负数
+void
+av_sync_audio_written(AVSync *s, double pts, int bytes);
+
+// seek 之后缓冲区里的音频都丢掉了，音频时钟等新数据写进来再重新开始
+void
+av_sync_audio_flush(AVSync *s);
+
+// seek 之后外部时钟从新位置的第一帧重新开始
+void
+av_sync_video_flush(AVSync *s);
+
+// 主时钟，pending_bytes 是缓冲区里还没有被回调取走的字节数
+// since_fill 是最近一次回调到现在的秒数，设备按这个时间扣掉已经播出的部分，不知道时传负数
+double
+av_sync_clock(AVSync *s, int64_t pending_bytes, double since_fill);
+
+// 决定一帧视频是显示、丢弃还是等待，需要等待时 wait 返回等待的时长
+// has_next 表示后面还有已经解码好的帧
+int
+av_sync_video(AVSync *s, double frame_pts, double clock, int has_next, double *wait);
+
+// 一帧视频被重复显示
+void
+av_sync_duplicated(AVSync *s);
+
+// 精确睡眠，不会空转
+void
+av_sync_sleep(double seconds);
+
+// 当前时间，单位秒，单调递增
+double
+av_sync_now(void);
+
+void
+av_sync_print_stats(AVSync *s);
+
+#endif
@@ -0,0 +1,332 @@
+#include "convert.h"
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <string.h>
+
+#include "pcm.h"
+
+struct SwsContext *
+scale_cache_get(ScaleCache *cache, int src_w, int src_h, enum AVPixelFormat src_fmt, int dst_w, int dst_h,
+                enum AVPixelFormat dst_fmt, int flags) {
+    ScaleKey key;
+    // 清零再赋值，保证结构体里的填充字节也相同，可以直接用 memcmp 比较
+    memset(&key, 0, sizeof(key));
+    key.src_w = src_w;
+    key.src_h = src_h;
+    key.src_fmt = src_fmt;
+    key.dst_w = dst_w;
+    key.dst_h = dst_h;
+    key.dst_fmt = dst_fmt;
+    key.flags = flags;
+
+    cache->tick += 1;
+    int victim = 0;
+    for (int i = 0; i < CONVERT_CACHE_SIZE; i++) {
+        if (cache->entries[i].ctx != NULL && memcmp(&cache->entries[i].key, &key, sizeof(key)) == 0) {
+            cache->entries[i].last_used = cache->tick;
+            return cache->entries[i].ctx;
+        }
+        if (cache->entries[i].last_used < cache->entries[victim].last_used) {
+            victim = i;
+        }
+    }
+
+    struct SwsContext *ctx = sws_getContext(src_w, src_h, src_fmt, dst_w, dst_h, dst_fmt, flags, NULL, NULL, NULL);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    sws_freeContext(cache->entries[victim].ctx);
+    cache->entries[victim].key = key;
+    cache->entries[victim].ctx = ctx;
+    cache->entries[victim].last_used = cache->tick;
+    return ctx;
+}
+
+struct SwsContext *
+scale_cache_get_frame(ScaleCache *cache, const AVFrame *src, int dst_w, int dst_h, enum AVPixelFormat dst_fmt,
+                      int flags) {
+    return scale_cache_get(cache, src->width, src->height, src->format, dst_w, dst_h, dst_fmt, flags);
+}
+
+void
+scale_cache_free(ScaleCache *cache) {
+    for (int i = 0; i < CONVERT_CACHE_SIZE; i++) {
+        sws_freeContext(cache->entries[i].ctx);
+        cache->entries[i].ctx = NULL;
+        cache->entries[i].last_used = 0;
+    }
+}
+
+SwrContext *
+resample_cache_get(ResampleCache *cache, uint64_t in_layout, enum AVSampleFormat in_fmt, int in_rate,
+                   uint64_t out_layout, enum AVSampleFormat out_fmt, int out_rate) {
+    ResampleKey key;
+    memset(&key, 0, sizeof(key));
+    key.in_layout = in_layout;
+    key.in_fmt = in_fmt;
+    key.in_rate = in_rate;
+    key.out_layout = out_layout;
+    key.out_fmt = out_fmt;
+    key.out_rate = out_rate;
+
+    cache->tick += 1;
+    int victim = 0;
+    for (int i = 0; i < CONVERT_CACHE_SIZE; i++) {
+        if (cache->entries[i].ctx != NULL && memcmp(&cache->entries[i].key, &key, sizeof(key)) == 0) {
+            cache->entries[i].last_used = cache->tick;
+            return cache->entries[i].ctx;
+        }
+        if (cache->entries[i].last_used < cache->entries[victim].last_used) {
+            victim = i;
+        }
+    }
+
+    SwrContext *ctx =
+        swr_alloc_set_opts(NULL, out_layout, out_fmt, out_rate, in_layout, in_fmt, in_rate, 0, NULL);
+    if (ctx == NULL || swr_init(ctx) < 0) {
+        swr_free(&ctx);
+        return NULL;
+    }
+    swr_free(&cache->entries[victim].ctx);
+    cache->entries[victim].key = key;
+    cache->entries[victim].ctx = ctx;
+    cache->entries[victim].last_used = cache->tick;
+    return ctx;
+}
+
+SwrContext *
+resample_cache_get_frame(ResampleCache *cache, const AVFrame *in, uint64_t out_layout, enum AVSampleFormat out_fmt,
+                         int out_rate) {
+    // 有些解码器不填声道布局，按声道数取默认布局
+    uint64_t in_layout = in->channel_layout;
+    if (in_layout == 0) {
+        in_layout = av_get_default_channel_layout(in->channels);
+    }
+    return resample_cache_get(cache, in_layout, in->format, in->sample_rate, out_layout, out_fmt, out_rate);
+}
+
+void
+resample_cache_reset(ResampleCache *cache) {
+    for (int i = 0; i < CONVERT_CACHE_SIZE; i++) {
+        // 对已经初始化的上下文再调用一次 swr_init 会清空内部状态，参数不变
+        if (cache->entries[i].ctx != NULL && swr_init(cache->entries[i].ctx) < 0) {
+            swr_free(&cache->entries[i].ctx);
+            cache->entries[i].last_used = 0;
+        }
+    }
+}
+
+void
+resample_cache_free(ResampleCache *cache) {
+    for (int i = 0; i < CONVERT_CACHE_SIZE; i++) {
+        swr_free(&cache->entries[i].ctx);
+        cache->entries[i].last_used = 0;
+    }
+}
+
+// 输出图像每行按 32 字节对齐，sws_scale 可以用 simd 写
+#define VIDEO_CONVERTER_ALIGN 32
+
+int
+video_converter_init(VideoConverter *conv, int width, int height, enum AVPixelFormat format, int flags) {
+    memset(conv, 0, sizeof(*conv));
+    conv->width = width;
+    conv->height = height;
+    conv->format = format;
+    conv->flags = flags;
+    int size = av_image_get_buffer_size(format, width, height, VIDEO_CONVERTER_ALIGN);
+    if (size < 0) {
+        return size;
+    }
+    conv->pool = av_buffer_pool_init(size, NULL);
+    if (conv->pool == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+int
+video_converter_passthrough(const VideoConverter *conv, const AVFrame *src) {
+    return src->format == conv->format && src->width == conv->width && src->height == conv->height;
+}
+
+int
+video_converter_convert(VideoConverter *conv, const AVFrame *src, AVFrame *dst) {
+    if (video_converter_passthrough(conv, src)) {
+        return av_frame_ref(dst, src);
+    }
+    struct SwsContext *sws_ctx =
+        scale_cache_get_frame(&conv->cache, src, conv->width, conv->height, conv->format, conv->flags);
+    if (sws_ctx == NULL) {
+        return AVERROR(EINVAL);
+    }
+    dst->buf[0] = av_buffer_pool_get(conv->pool);
+    if (dst->buf[0] == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    av_image_fill_arrays(dst->data, dst->linesize, dst->buf[0]->data, conv->format, conv->width, conv->height,
+                         VIDEO_CONVERTER_ALIGN);
+    dst->format = conv->format;
+    dst->width = conv->width;
+    dst->height = conv->height;
+    // pts、sample_aspect_ratio 等信息跟着原来的 frame 走
+    av_frame_copy_props(dst, src);
+    sws_scale(sws_ctx, (const uint8_t *const *)src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    return 0;
+}
+
+void
+video_converter_free(VideoConverter *conv) {
+    scale_cache_free(&conv->cache);
+    av_buffer_pool_uninit(&conv->pool);
+}
+
+void
+audio_converter_init(AudioConverter *conv, uint64_t layout, enum AVSampleFormat format, int sample_rate) {
+    memset(conv, 0, sizeof(*conv));
+    conv->layout = layout;
+    conv->channels = av_get_channel_layout_nb_channels(layout);
+    conv->format = format;
+    conv->sample_rate = sample_rate;
+}
+
+int
+audio_converter_convert(AudioConverter *conv, const AVFrame *src, AVFrame *dst) {
+    SwrContext *swr_ctx = resample_cache_get_frame(&conv->cache, src, conv->layout, conv->format, conv->sample_rate);
+    if (swr_ctx == NULL) {
+        return AVERROR(EINVAL);
+    }
+    dst->channel_layout = conv->layout;
+    dst->channels = conv->channels;
+    dst->format = conv->format;
+    dst->sample_rate = conv->sample_rate;
+    return swr_convert_frame(swr_ctx, dst, src);
+}
+
+// 保证输出缓冲区能放下 samples 个采样，重新分配时原来的内容不保留
+static int
+audio_converter_reserve(AudioConverter *conv, int samples) {
+    if (samples <= conv->buffer_samples) {
+        return 0;
+    }
+    av_freep(&conv->buffer);
+    conv->buffer_samples = 0;
+    int ret = av_samples_alloc(&conv->buffer, NULL, conv->channels, samples, conv->format, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    conv->buffer_samples = samples;
+    return 0;
+}
+
+// 采样率和声道布局不变、输出 float 时只是交错或者转 float，不用 swresample
+static int
+audio_converter_direct_supported(const AudioConverter *conv, const AVFrame *src) {
+    uint64_t layout = src->channel_layout != 0 ? src->channel_layout : av_get_default_channel_layout(src->channels);
+    return conv->format == AV_SAMPLE_FMT_FLT && src->sample_rate == conv->sample_rate && layout == conv->layout &&
+           (src->format == AV_SAMPLE_FMT_FLTP || src->format == AV_SAMPLE_FMT_FLT || src->format == AV_SAMPLE_FMT_S16);
+}
+
+// 直接转换到 dst，返回采样数
+static int
+audio_converter_direct(AudioConverter *conv, const AVFrame *src, float *dst) {
+    int count = src->nb_samples * conv->channels;
+    switch (src->format) {
+    case AV_SAMPLE_FMT_FLTP:
+        pcm_interleave_float(dst, (const float *const *)src->extended_data, conv->channels, src->nb_samples);
+        break;
+    case AV_SAMPLE_FMT_FLT:
+        memcpy(dst, src->data[0], count * sizeof(float));
+        break;
+    default:
+        pcm_s16_to_float(dst, (const int16_t *)src->data[0], count);
+        break;
+    }
+    return src->nb_samples;
+}
+
+// 输出缓冲区里第 offset 个采样的位置
+static uint8_t *
+audio_converter_at(AudioConverter *conv, int offset) {
+    return conv->buffer + offset * conv->channels * av_get_bytes_per_sample(conv->format);
+}
+
+int
+audio_converter_convert_buffer(AudioConverter *conv, const AVFrame *src, uint8_t **data) {
+    SwrContext *swr_ctx = NULL;
+    if (!audio_converter_direct_supported(conv, src)) {
+        // 上一帧用的上下文最近用过，不会在这里被替换掉
+        swr_ctx = resample_cache_get_frame(&conv->cache, src, conv->layout, conv->format, conv->sample_rate);
+        if (swr_ctx == NULL) {
+            return AVERROR(EINVAL);
+        }
+    }
+    // 流的参数变了，换了转换方式，上一个 SwrContext 里还没输出的采样先排出来放在这一帧前面
+    // 否则这些采样会丢掉，或者切回来时晚一段才输出，顺序就乱了
+    SwrContext *tail_ctx = conv->last_swr != swr_ctx ? conv->last_swr : NULL;
+    int tail = tail_ctx != NULL ? swr_get_out_samples(tail_ctx, 0) : 0;
+    // 这一帧最多输出多少采样，用 swresample 时包括重采样器里上一帧留下来的
+    int samples = swr_ctx != NULL ? swr_get_out_samples(swr_ctx, src->nb_samples) : src->nb_samples;
+    if (tail < 0 || samples < 0) {
+        return AVERROR(EINVAL);
+    }
+    int ret = audio_converter_reserve(conv, tail + samples);
+    if (ret < 0) {
+        return ret;
+    }
+    if (tail > 0) {
+        // 输入传 NULL 把延迟线里的采样也排出来，排空后重新初始化，以后切回来从干净的状态开始
+        tail = swr_convert(tail_ctx, &conv->buffer, tail, NULL, 0);
+        if (tail < 0 || swr_init(tail_ctx) < 0) {
+            return AVERROR(EINVAL);
+        }
+    }
+    conv->last_swr = swr_ctx;
+
+    uint8_t *out = audio_converter_at(conv, tail);
+    if (swr_ctx == NULL) {
+        ret = audio_converter_direct(conv, src, (float *)out);
+    } else {
+        ret = swr_convert(swr_ctx, &out, samples, (const uint8_t **)src->extended_data, src->nb_samples);
+    }
+    *data = conv->buffer;
+    return ret < 0 ? ret : tail + ret;
+}
+
+int
+audio_converter_drain(AudioConverter *conv, uint8_t **data) {
+    *data = conv->buffer;
+    if (conv->last_swr == NULL) {
+        return 0;
+    }
+    int samples = swr_get_out_samples(conv->last_swr, 0);
+    if (samples <= 0) {
+        return samples;
+    }
+    int ret = audio_converter_reserve(conv, samples);
+    if (ret < 0) {
+        return ret;
+    }
+    *data = conv->buffer;
+    ret = swr_convert(conv->last_swr, &conv->buffer, samples, NULL, 0);
+    // 排空以后重新初始化，seek 回去接着转换时从干净的状态开始
+    if (swr_init(conv->last_swr) < 0) {
+        ret = AVERROR(EINVAL);
+    }
+    return ret;
+}
+
+void
+audio_converter_reset(AudioConverter *conv) {
+    resample_cache_reset(&conv->cache);
+    conv->last_swr = NULL;
+}
+
+void
+audio_converter_free(AudioConverter *conv) {
+    resample_cache_free(&conv->cache);
+    av_freep(&conv->buffer);
+    conv->buffer_samples = 0;
+}
@@ -0,0 +1,148 @@
+#ifndef COMMON_CONVERT_H
+#define COMMON_CONVERT_H
+
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+
+// 缓存最近用过的几个转换上下文
+// 流中途切换分辨率或格式时（比如插播广告）按新参数取上下文，切回来时直接复用旧的，不用重新创建
+#define CONVERT_CACHE_SIZE 4
+
+typedef struct ScaleKey {
+    int src_w;
+    int src_h;
+    enum AVPixelFormat src_fmt;
+    int dst_w;
+    int dst_h;
+    enum AVPixelFormat dst_fmt;
+    int flags;
+} ScaleKey;
+
+typedef struct ScaleCache {
+    struct {
+        ScaleKey key;
+        struct SwsContext *ctx;
+        int64_t last_used;
+    } entries[CONVERT_CACHE_SIZE];
+    int64_t tick;
+} ScaleCache;
+
+typedef struct ResampleKey {
+    uint64_t in_layout;
+    enum AVSampleFormat in_fmt;
+    int in_rate;
+    uint64_t out_layout;
+    enum AVSampleFormat out_fmt;
+    int out_rate;
+} ResampleKey;
+
+typedef struct ResampleCache {
+    struct {
+        ResampleKey key;
+        SwrContext *ctx;
+        int64_t last_used;
+    } entries[CONVERT_CACHE_SIZE];
+    int64_t tick;
+} ResampleCache;
+
+// 取参数对应的 SwsContext，没有就创建，缓存满了替换最久没用的那个
+// 返回的上下文归缓存所有，不要自己释放
+struct SwsContext *
+scale_cache_get(ScaleCache *cache, int src_w, int src_h, enum AVPixelFormat src_fmt, int dst_w, int dst_h,
+                enum AVPixelFormat dst_fmt, int flags);
+
+// 按 src 的宽高和格式取 SwsContext
+struct SwsContext *
+scale_cache_get_frame(ScaleCache *cache, const AVFrame *src, int dst_w, int dst_h, enum AVPixelFormat dst_fmt,
+                      int flags);
+
+void
+scale_cache_free(ScaleCache *cache);
+
+// 取参数对应的已经初始化好的 SwrContext
+SwrContext *
+resample_cache_get(ResampleCache *cache, uint64_t in_layout, enum AVSampleFormat in_fmt, int in_rate,
+                   uint64_t out_layout, enum AVSampleFormat out_fmt, int out_rate);
+
+// 按 in 的声道布局、采样格式和采样率取 SwrContext
+SwrContext *
+resample_cache_get_frame(ResampleCache *cache, const AVFrame *in, uint64_t out_layout, enum AVSampleFormat out_fmt,
+                         int out_rate);
+
+// 丢掉所有 SwrContext 里缓存的采样（重采样的延迟线），比如 seek 之后，上下文仍然留在缓存里
+void
+resample_cache_reset(ResampleCache *cache);
+
+void
+resample_cache_free(ResampleCache *cache);
+
+// 把视频帧转换成固定的大小和格式
+// 输出图像的内存从 AVBufferPool 里取，输出 frame 释放后内存回到池里，下一帧直接复用，不会每帧申请一次
+typedef struct VideoConverter {
+    ScaleCache cache;
+    int width;
+    int height;
+    enum AVPixelFormat format;
+    int flags;
+    AVBufferPool *pool;
+} VideoConverter;
+
+int
+video_converter_init(VideoConverter *conv, int width, int height, enum AVPixelFormat format, int flags);
+
+// src 已经是目标大小和格式，不需要转换
+int
+video_converter_passthrough(const VideoConverter *conv, const AVFrame *src);
+
+// 转换 src，结果引用到空的 dst 里，用完 av_frame_unref
+// src 已经是目标大小和格式时 dst 只是增加引用，不拷贝
+int
+video_converter_convert(VideoConverter *conv, const AVFrame *src, AVFrame *dst);
+
+// 还没释放的输出 frame 仍然有效，最后一个释放时池才真正销毁
+void
+video_converter_free(VideoConverter *conv);
+
+// 把音频帧转换成固定的声道布局、采样格式和采样率
+typedef struct AudioConverter {
+    ResampleCache cache;
+    uint64_t layout;
+    int channels;
+    enum AVSampleFormat format;
+    int sample_rate;
+    // audio_converter_convert_buffer 的输出缓冲区，能放下 buffer_samples 个采样
+    uint8_t *buffer;
+    int buffer_samples;
+    // audio_converter_convert_buffer 上一帧用的 SwrContext（归缓存所有），上一帧直接转换时为 NULL
+    SwrContext *last_swr;
+} AudioConverter;
+
+void
+audio_converter_init(AudioConverter *conv, uint64_t layout, enum AVSampleFormat format, int sample_rate);
+
+// 转换 src，结果放在空的 dst 里，用完 av_frame_unref
+int
+audio_converter_convert(AudioConverter *conv, const AVFrame *src, AVFrame *dst);
+
+// 转换 src，结果放在转换器自己的缓冲区里，*data 指向转换后的数据，返回输出的采样数
+// 缓冲区按 swr_get_out_samples 的大小分配，一帧的采样数变多时才重新分配，稳定以后每帧不再申请内存
+// 采样率和声道布局不变、输出 float 时，fltp / flt / s16 输入直接用 common/pcm.c 的 SIMD 函数转换，不经过 swresample
+// *data 在下一次转换之前有效，输出格式必须是交错（packed）的
+// 两种方式之间切换时，先输出上一个重采样器里剩下的采样，不会丢失或者乱序
+int
+audio_converter_convert_buffer(AudioConverter *conv, const AVFrame *src, uint8_t **data);
+
+// 解码结束后调用，取出重采样器里剩下的采样，用法和 audio_converter_convert_buffer 一样，没有剩下的返回 0
+int
+audio_converter_drain(AudioConverter *conv, uint8_t **data);
+
+// seek 之后调用，重采样器里还没输出的旧位置的采样全部丢掉
+void
+audio_converter_reset(AudioConverter *conv);
+
+void
+audio_converter_free(AudioConverter *conv);
+
+#endif
@@ -0,0 +1,432 @@
+#include "decoder.h"
+
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int
+parse_thread_type(const char *value) {
+    if (strcmp(value, "frame") == 0) {
+        return FF_THREAD_FRAME;
+    } else if (strcmp(value, "slice") == 0) {
+        return FF_THREAD_SLICE;
+    }
+    return FF_THREAD_FRAME | FF_THREAD_SLICE;
+}
+
+int
+decoder_parse_args(DecoderOptions *opts, int argc, const char **argv) {
+    opts->thread_count = 0;
+    opts->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    opts->lowres_width = 0;
+    opts->lowres_height = 0;
+    opts->quiet = 0;
+
+    const char *env = getenv("DECODER_THREADS");
+    if (env != NULL) {
+        opts->thread_count = atoi(env);
+    }
+    env = getenv("DECODER_THREAD_TYPE");
+    if (env != NULL) {
+        opts->thread_type = parse_thread_type(env);
+    }
+
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            opts->thread_count = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--thread-type=", 14) == 0) {
+            opts->thread_type = parse_thread_type(argv[i] + 14);
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    return n;
+}
+
+// 解码器输出图像用的内存，每个平面一个 AVBufferPool，按流的宽高和像素格式分配
+// 帧释放后内存回到池里，池里的块够用以后解码不再申请内存
+// 帧级多线程时几个解码线程会同时调用 get_buffer2，lock 保护分辨率变化时重建池
+struct FrameBufferPool {
+    pthread_mutex_t lock;
+    AVBufferPool *pools[4];
+    int format;
+    int width;
+    int height;
+    int linesize[4];
+    // 所有平面的池里一共新分配的内存块数
+    int allocated;
+};
+
+// 和 libavcodec 默认的 get_buffer2 一样，给越界读写的 SIMD 代码留的余量
+#define FRAME_BUFFER_PADDING (16 + 64 - 1)
+
+static AVBufferRef *
+frame_buffer_alloc(void *opaque, int size) {
+    FrameBufferPool *p = opaque;
+    // 只在拿着 lock 的 get_buffer2 里调用
+    p->allocated += 1;
+    return av_buffer_alloc(size);
+}
+
+static void
+frame_buffer_pool_uninit(FrameBufferPool *p) {
+    // 解码出来的帧还没释放时，池要等最后一块内存回来才真正销毁
+    for (int i = 0; i < 4; i++) {
+        av_buffer_pool_uninit(&p->pools[i]);
+    }
+}
+
+// 按 frame 的宽高和格式计算每个平面的行宽和大小，重建池
+static int
+frame_buffer_pool_update(FrameBufferPool *p, AVCodecContext *ctx, const AVFrame *frame) {
+    frame_buffer_pool_uninit(p);
+
+    // 解码器会写到对齐后的宽高，行宽也要满足解码器的对齐要求
+    int w = frame->width;
+    int h = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+    int unaligned;
+    do {
+        int ret = av_image_fill_linesizes(p->linesize, frame->format, w);
+        if (ret < 0) {
+            return ret;
+        }
+        // 行宽不满足对齐时把宽度加大到下一个 2 的幂次的倍数再算
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (int i = 0; i < 4; i++) {
+            unaligned |= p->linesize[i] % linesize_align[i];
+        }
+    } while (unaligned);
+
+    // 每个平面的大小：色度平面（1、2）的高度按色度采样缩小，调色板格式的第二个平面是 256 色的调色板
+    // 和 av_image_fill_pointers 里的算法一样，不依赖 4.4 才有的 av_image_fill_plane_sizes
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    for (int i = 0; i < 4; i++) {
+        int64_t plane_size;
+        if (p->linesize[i] > 0) {
+            int plane_h = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(h, desc->log2_chroma_h) : h;
+            plane_size = (int64_t)p->linesize[i] * plane_h;
+        } else if (i == 1 && (desc->flags & AV_PIX_FMT_FLAG_PAL)) {
+            plane_size = 256 * 4;
+        } else {
+            break;
+        }
+        if (plane_size > INT_MAX - FRAME_BUFFER_PADDING) {
+            frame_buffer_pool_uninit(p);
+            return AVERROR(EINVAL);
+        }
+        p->pools[i] = av_buffer_pool_init2((int)plane_size + FRAME_BUFFER_PADDING, p, frame_buffer_alloc, NULL);
+        if (p->pools[i] == NULL) {
+            frame_buffer_pool_uninit(p);
+            return AVERROR(ENOMEM);
+        }
+    }
+    if (p->pools[0] == NULL) {
+        return AVERROR(EINVAL);
+    }
+    p->format = frame->format;
+    p->width = frame->width;
+    p->height = frame->height;
+    return 0;
+}
+
+static int
+pooled_get_buffer2(AVCodecContext *ctx, AVFrame *frame, int flags) {
+    FrameBufferPool *p = ctx->opaque;
+    // 音频、硬件解码和不支持直接写入外部内存（DR1）的解码器用默认实现
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    if (ctx->codec_type != AVMEDIA_TYPE_VIDEO || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) || desc == NULL ||
+        (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    int ret = 0;
+    if (p->pools[0] == NULL || p->format != frame->format || p->width != frame->width ||
+        p->height != frame->height) {
+        ret = frame_buffer_pool_update(p, ctx, frame);
+    }
+    for (int i = 0; ret == 0 && i < 4 && p->pools[i] != NULL; i++) {
+        frame->buf[i] = av_buffer_pool_get(p->pools[i]);
+        if (frame->buf[i] == NULL) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = p->linesize[i];
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (ret < 0) {
+        // 池建不起来（比如格式算不出平面大小）或者取不到内存时用默认实现
+        // 不能 av_frame_unref，解码器填好的宽高和格式还要用
+        for (int i = 0; i < 4; i++) {
+            av_buffer_unref(&frame->buf[i]);
+            frame->data[i] = NULL;
+            frame->linesize[i] = 0;
+        }
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+static FrameBufferPool *
+frame_buffer_pool_alloc(void) {
+    FrameBufferPool *p = calloc(1, sizeof(*p));
+    if (p != NULL) {
+        pthread_mutex_init(&p->lock, NULL);
+    }
+    return p;
+}
+
+static void
+frame_buffer_pool_free(FrameBufferPool **p) {
+    if (*p == NULL) {
+        return;
+    }
+    frame_buffer_pool_uninit(*p);
+    pthread_mutex_destroy(&(*p)->lock);
+    free(*p);
+    *p = NULL;
+}
+
+// buffers 不为 NULL 时视频帧的内存从 buffers 里分配，要在 codec_ctx 释放以后再释放 buffers
+static int
+open_codec(AVFormatContext *fmt_ctx, int stream_index, const DecoderOptions *opts, FrameBufferPool *buffers,
+           AVCodecContext **codec_ctx) {
+    AVStream *stream = fmt_ctx->streams[stream_index];
+    AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (codec == NULL) {
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (ctx == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = avcodec_parameters_to_context(ctx, stream->codecpar);
+    if (ret < 0) {
+        avcodec_free_context(&ctx);
+        return ret;
+    }
+
+    // 自动模式用全部核，ffmpeg 自己的自动模式最多只开 16 个线程
+    int thread_count = opts->thread_count;
+    if (thread_count <= 0) {
+        thread_count = av_cpu_count();
+    }
+    ctx->thread_count = thread_count;
+    ctx->thread_type = opts->thread_type;
+
+    // lowres 要在打开之前设置，打开后 width / height 就是缩小后的大小
+    if ((opts->lowres_width > 0 || opts->lowres_height > 0) && codec->max_lowres > 0) {
+        int lowres = 0;
+        while (lowres < codec->max_lowres && (ctx->width >> (lowres + 1)) >= opts->lowres_width &&
+               (ctx->height >> (lowres + 1)) >= opts->lowres_height) {
+            lowres += 1;
+        }
+        ctx->lowres = lowres;
+    }
+
+    // get_buffer2 要在打开之前设置，帧级多线程的每个线程都复制了一份 context
+    if (buffers != NULL && ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ctx->get_buffer2 = pooled_get_buffer2;
+        ctx->opaque = buffers;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+        // 老版本默认认为自定义的 get_buffer2 不能多线程调用，会把每次调用都排队交给主线程
+        // pooled_get_buffer2 自己加了锁，直接在解码线程里调用
+        ctx->thread_safe_callbacks = 1;
+#endif
+    }
+
+    ret = avcodec_open2(ctx, codec, NULL);
+    if (ret < 0) {
+        avcodec_free_context(&ctx);
+        return ret;
+    }
+
+    // 解码器不支持的多线程方式会被忽略，打印实际生效的配置
+    const char *type = "none";
+    if (ctx->active_thread_type & FF_THREAD_FRAME) {
+        type = "frame";
+    } else if (ctx->active_thread_type & FF_THREAD_SLICE) {
+        type = "slice";
+    }
+    if (!opts->quiet) {
+        printf("decoder %s: %d threads, %s threading\n", codec->name, ctx->thread_count, type);
+        if (ctx->lowres > 0) {
+            printf("decoder %s: lowres %d, %dx%d\n", codec->name, ctx->lowres, ctx->width, ctx->height);
+        }
+    }
+
+    *codec_ctx = ctx;
+    return 0;
+}
+
+int
+open_decoder(AVFormatContext *fmt_ctx, int stream_index, const DecoderOptions *opts, AVCodecContext **codec_ctx) {
+    return open_codec(fmt_ctx, stream_index, opts, NULL, codec_ctx);
+}
+
+int
+decoder_open(Decoder *dec, AVFormatContext *fmt_ctx, int stream_index, const DecoderOptions *opts) {
+    memset(dec, 0, sizeof(*dec));
+    dec->stream_index = -1;
+    dec->buffers = frame_buffer_pool_alloc();
+    if (dec->buffers == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = open_codec(fmt_ctx, stream_index, opts, dec->buffers, &dec->codec_ctx);
+    if (ret < 0) {
+        frame_buffer_pool_free(&dec->buffers);
+    }
+    const char *type = av_get_media_type_string(fmt_ctx->streams[stream_index]->codecpar->codec_type);
+    if (ret == AVERROR_DECODER_NOT_FOUND) {
+        printf("Unsupported %s codec\n", type != NULL ? type : "");
+        return ret;
+    } else if (ret < 0) {
+        printf("Could not open %s codec\n", type != NULL ? type : "");
+        return ret;
+    }
+    dec->pending = av_packet_alloc();
+    if (dec->pending == NULL) {
+        avcodec_free_context(&dec->codec_ctx);
+        frame_buffer_pool_free(&dec->buffers);
+        return AVERROR(ENOMEM);
+    }
+    dec->stream = fmt_ctx->streams[stream_index];
+    dec->stream_index = stream_index;
+    return 0;
+}
+
+void
+decoder_close(Decoder *dec) {
+    // avcodec_close 只关闭解码器，context 本身要用 avcodec_free_context 释放
+    avcodec_free_context(&dec->codec_ctx);
+    // 解码器关了以后不会再取内存，还在外面的帧可以继续用
+    frame_buffer_pool_free(&dec->buffers);
+    av_packet_free(&dec->pending);
+    dec->has_pending = 0;
+    dec->stream = NULL;
+    dec->stream_index = -1;
+}
+
+// 把暂存的 packet 和排空请求按顺序发给解码器，解码器还是不收时返回 AVERROR(EAGAIN)
+static int
+send_pending(Decoder *dec) {
+    int ret;
+    if (dec->has_pending) {
+        ret = avcodec_send_packet(dec->codec_ctx, dec->pending);
+        if (ret == AVERROR(EAGAIN)) {
+            return ret;
+        }
+        // 每个 packet 只在这里 unref 一次
+        av_packet_unref(dec->pending);
+        dec->has_pending = 0;
+        if (ret < 0) {
+            return ret;
+        }
+        dec->packets_in += 1;
+    }
+    if (dec->drain == DECODER_DRAIN_REQUESTED) {
+        ret = avcodec_send_packet(dec->codec_ctx, NULL);
+        if (ret == AVERROR(EAGAIN)) {
+            return ret;
+        }
+        dec->drain = DECODER_DRAIN_SENT;
+        if (ret < 0 && ret != AVERROR_EOF) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int
+decoder_send_packet(Decoder *dec, AVPacket *packet) {
+    if (packet == NULL) {
+        if (dec->drain == DECODER_DRAIN_NONE) {
+            dec->drain = DECODER_DRAIN_REQUESTED;
+        }
+    } else if (dec->has_pending || dec->drain != DECODER_DRAIN_NONE) {
+        // 上一个 packet 还没送进去就又来一个，或者已经在排空，说明调用方没有 receive 到 EAGAIN
+        av_packet_unref(packet);
+        return AVERROR(EINVAL);
+    } else {
+        av_packet_move_ref(dec->pending, packet);
+        dec->has_pending = 1;
+    }
+    int ret = send_pending(dec);
+    // 解码器满了，packet 留着，等 receive 取走帧以后再发
+    return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+int
+decoder_receive_frame(Decoder *dec, AVFrame *frame) {
+    while (1) {
+        int ret = avcodec_receive_frame(dec->codec_ctx, frame);
+        if (ret == 0) {
+            dec->frames_out += 1;
+            if (dec->drain == DECODER_DRAIN_SENT) {
+                dec->frames_drained += 1;
+            }
+            return 0;
+        } else if (ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+        if (!dec->has_pending && dec->drain != DECODER_DRAIN_REQUESTED) {
+            return ret;
+        }
+        // 解码器的帧取完了，把之前没收的 packet 或者排空请求再发一次
+        ret = send_pending(dec);
+        if (ret == AVERROR(EAGAIN)) {
+            // 两边都说 EAGAIN，解码器的状态不对
+            return AVERROR_BUG;
+        } else if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+void
+decoder_flush(Decoder *dec) {
+    avcodec_flush_buffers(dec->codec_ctx);
+    av_packet_unref(dec->pending);
+    dec->has_pending = 0;
+    dec->drain = DECODER_DRAIN_NONE;
+}
+
+void
+decoder_print_stats(const Decoder *dec, const char *name) {
+    printf("%s decoder: %lld packets in, %lld frames out, %lld frames from drain\n", name,
+           (long long)dec->packets_in, (long long)dec->frames_out, (long long)dec->frames_drained);
+    if (dec->buffers != NULL && dec->buffers->pools[0] != NULL) {
+        // 每个平面一块，稳定播放时这个数不再增长，对应解码器和播放队列同时压着的最多帧数
+        pthread_mutex_lock(&dec->buffers->lock);
+        printf("%s decoder: %dx%d, %d plane buffers allocated\n", name, dec->buffers->width, dec->buffers->height,
+               dec->buffers->allocated);
+        pthread_mutex_unlock(&dec->buffers->lock);
+    }
+}
+
+void
+decode_stats_init(DecodeStats *stats) {
+    stats->frames = 0;
+    stats->start = av_gettime_relative();
+}
+
+void
+decode_stats_print(const DecodeStats *stats, const char *name) {
+    double seconds = (av_gettime_relative() - stats->start) / 1000000.0;
+    double fps = seconds > 0 ? stats->frames / seconds : 0;
+    printf("%s: decoded %lld frames in %.2fs, %.1f fps\n", name, (long long)stats->frames, seconds, fps);
+}
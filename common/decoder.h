@@ -0,0 +1,111 @@
+#ifndef COMMON_DECODER_H
+#define COMMON_DECODER_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+// 解码器的多线程配置
+// 默认按 cpu 核数自动选择线程数，帧级和 slice 级多线程都允许
+// 可以用环境变量 DECODER_THREADS / DECODER_THREAD_TYPE
+// 或者命令行参数 --threads=N / --thread-type=frame|slice|auto 修改，命令行优先
+typedef struct DecoderOptions {
+    // 0 表示自动选择
+    int thread_count;
+    // FF_THREAD_FRAME / FF_THREAD_SLICE 的组合
+    int thread_type;
+    // 不是 0 时，解码器支持的话直接输出缩小 2^n 倍的图像，缩小后不小于这个大小
+    // 只用来做缩略图，解码器只需要重建一部分系数，解码和后面的转换都更快
+    int lowres_width;
+    int lowres_height;
+    // 不为 0 时打开解码器不打印实际生效的线程和 lowres 配置，批量处理时用
+    int quiet;
+} DecoderOptions;
+
+typedef struct FrameBufferPool FrameBufferPool;
+
+// 打开的解码器，decoder_open 成功后用 decoder_close 释放
+// decoder_close 可以重复调用，清零的结构体也可以直接 close
+//
+// 解码用 decoder_send_packet / decoder_receive_frame，每发送一个 packet 就一直 receive 到返回 AVERROR(EAGAIN)
+// 文件读完后发送 NULL 开始排空，解码器把重排序和多线程缓存的帧都吐出来，receive 返回 AVERROR_EOF 时才真正结束
+// 帧级多线程时解码器会压着 线程数 个左右的帧，不排空最后这些帧就丢了
+//
+// 视频帧的内存从按流的大小建的 AVBufferPool 里取，帧释放后回到池里
+// 解码出来的帧可以一直引用着（比如放进播放队列），池里的块够用以后每帧不再申请内存
+typedef struct Decoder {
+    AVCodecContext *codec_ctx;
+    AVStream *stream;
+    int stream_index;
+    FrameBufferPool *buffers;
+    // 解码器暂时不收（send 返回 EAGAIN）的 packet，取走帧以后 receive 里自动重新发送
+    AVPacket *pending;
+    int has_pending;
+    // DECODER_DRAIN_*
+    int drain;
+    // 发送给解码器的 packet 数、解码出的帧数，以及其中排空时才吐出来的帧数
+    int64_t packets_in;
+    int64_t frames_out;
+    int64_t frames_drained;
+} Decoder;
+
+enum {
+    DECODER_DRAIN_NONE,
+    // 已经要求排空，还没把 NULL 发给解码器
+    DECODER_DRAIN_REQUESTED,
+    DECODER_DRAIN_SENT,
+};
+
+// 统计解码速度
+typedef struct DecodeStats {
+    int64_t frames;
+    int64_t start;
+} DecodeStats;
+
+// 用环境变量初始化配置，然后从 argv 里取出解码器相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+decoder_parse_args(DecoderOptions *opts, int argc, const char **argv);
+
+// 找到 stream_index 对应流的解码器，按 opts 配置好多线程后打开
+// 成功返回 0，codec_ctx 由调用方释放
+int
+open_decoder(AVFormatContext *fmt_ctx, int stream_index, const DecoderOptions *opts, AVCodecContext **codec_ctx);
+
+// 用 open_decoder 打开 stream_index 对应流的解码器，出错时打印原因
+int
+decoder_open(Decoder *dec, AVFormatContext *fmt_ctx, int stream_index, const DecoderOptions *opts);
+
+void
+decoder_close(Decoder *dec);
+
+// 把 packet 交给解码器，packet 为 NULL 表示输入结束，开始排空
+// packet 的数据无论成功失败都转移走了，调用方不用再 unref，packet 可以直接用来读下一个
+int
+decoder_send_packet(Decoder *dec, AVPacket *packet);
+
+// 取一帧，成功返回 0
+// AVERROR(EAGAIN) 表示要发送下一个 packet，AVERROR_EOF 表示排空结束，后面不会再有帧
+int
+decoder_receive_frame(Decoder *dec, AVFrame *frame);
+
+// seek 之后清空解码器里旧位置的数据，排空结束后还要继续解码也要调用
+void
+decoder_flush(Decoder *dec);
+
+// 打印送进去的 packet 数、解码出的帧数和帧内存池分配过的内存块数
+void
+decoder_print_stats(const Decoder *dec, const char *name);
+
+void
+decode_stats_init(DecodeStats *stats);
+
+static inline void
+decode_stats_frame(DecodeStats *stats) {
+    stats->frames += 1;
+}
+
+// 打印解码了多少帧、每秒解码多少帧
+void
+decode_stats_print(const DecodeStats *stats, const char *name);
+
+#endif
@@ -0,0 +1,391 @@
+#include "demux.h"
+
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// 流参数缓存文件的格式
+// 文件头，然后每个流一个 StreamCacheEntry 加上 extradata
+#define STREAM_CACHE_MAGIC 0x32435350 // "PSC2"
+
+typedef struct StreamCacheHeader {
+    int64_t magic;
+    // 媒体文件的大小和修改时间，任何一个变了缓存就作废
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t nb_streams;
+    int64_t start_time;
+    int64_t duration;
+    int64_t bit_rate;
+    // 探测过的流类型（DEMUX_WANT_*），其他类型的流参数可能不完整，需要它们的程序不能用这份缓存
+    int64_t want;
+} StreamCacheHeader;
+
+// 全部用 int64_t，结构体里没有填充，可以直接读写
+typedef struct StreamCacheEntry {
+    int64_t codec_type;
+    int64_t codec_id;
+    int64_t format;
+    int64_t width;
+    int64_t height;
+    int64_t sample_aspect_ratio_num;
+    int64_t sample_aspect_ratio_den;
+    int64_t sample_rate;
+    int64_t channels;
+    int64_t channel_layout;
+    int64_t frame_size;
+    int64_t time_base_num;
+    int64_t time_base_den;
+    int64_t r_frame_rate_num;
+    int64_t r_frame_rate_den;
+    int64_t avg_frame_rate_num;
+    int64_t avg_frame_rate_den;
+    int64_t start_time;
+    int64_t duration;
+    int64_t extradata_size;
+} StreamCacheEntry;
+
+void
+demux_keep_streams(AVFormatContext *fmt_ctx, int video_stream_index, int audio_stream_index) {
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i == video_stream_index || (int)i == audio_stream_index) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_DEFAULT;
+        } else {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+}
+
+void
+demux_stats_init(DemuxStats *stats) {
+    *stats = (DemuxStats){0};
+}
+
+void
+demux_stats_print(const DemuxStats *stats, const AVFormatContext *fmt_ctx) {
+    // 有些格式不通过 AVIOContext 读文件，这时只有 packet 的统计
+    int64_t file_bytes = fmt_ctx->pb != NULL ? fmt_ctx->pb->bytes_read : stats->packet_bytes;
+    double used = file_bytes > 0 ? 100.0 * stats->used_bytes / file_bytes : 0;
+    printf("demux: read %lld bytes from file, got %lld packets (%lld bytes), used %lld packets (%lld bytes, %.1f%%)\n",
+           (long long)file_bytes, (long long)stats->packets, (long long)stats->packet_bytes,
+           (long long)stats->used_packets, (long long)stats->used_bytes, used);
+}
+
+int
+probe_parse_args(ProbeOptions *opts, int argc, const char **argv) {
+    opts->fast = 0;
+    opts->probesize = 0;
+    opts->analyzeduration = 0;
+    opts->use_cache = 0;
+
+    const char *env = getenv("FAST_START");
+    if (env != NULL) {
+        opts->fast = atoi(env);
+    }
+    env = getenv("STREAM_CACHE");
+    if (env != NULL) {
+        opts->use_cache = atoi(env);
+    }
+
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast-start") == 0) {
+            opts->fast = 1;
+        } else if (strcmp(argv[i], "--stream-cache") == 0) {
+            opts->use_cache = 1;
+        } else if (strncmp(argv[i], "--probesize=", 12) == 0) {
+            opts->probesize = atoll(argv[i] + 12);
+        } else if (strncmp(argv[i], "--analyzeduration=", 18) == 0) {
+            opts->analyzeduration = atoll(argv[i] + 18);
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    return n;
+}
+
+// 流的参数足够打开解码器、创建纹理或者音频设备
+static int
+stream_params_complete(const AVStream *st) {
+    const AVCodecParameters *par = st->codecpar;
+    if (par->codec_id == AV_CODEC_ID_NONE) {
+        return 0;
+    }
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+        return par->width > 0 && par->height > 0 && par->format >= 0;
+    }
+    if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+        return par->sample_rate > 0 && par->channels > 0 && par->format >= 0;
+    }
+    return 1;
+}
+
+// 需要的流参数都已经有了，就不用再解码一段数据来探测
+static int
+wanted_streams_complete(const AVFormatContext *fmt_ctx, int want) {
+    int found = 0;
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        const AVStream *st = fmt_ctx->streams[i];
+        int type = st->codecpar->codec_type;
+        if ((type == AVMEDIA_TYPE_VIDEO && (want & DEMUX_WANT_VIDEO)) ||
+            (type == AVMEDIA_TYPE_AUDIO && (want & DEMUX_WANT_AUDIO))) {
+            if (!stream_params_complete(st)) {
+                return 0;
+            }
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// 不需要的流设成 AVDISCARD_ALL，avformat_find_stream_info 不再解码它们、等它们的参数
+// 返回实际探测了参数的流类型，丢掉了音频或视频流时其他音视频流的参数可能不完整
+static int
+discard_unwanted_streams(AVFormatContext *fmt_ctx, int want) {
+    int probed = DEMUX_WANT_VIDEO | DEMUX_WANT_AUDIO;
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        AVStream *st = fmt_ctx->streams[i];
+        int type = st->codecpar->codec_type;
+        if ((type == AVMEDIA_TYPE_VIDEO && (want & DEMUX_WANT_VIDEO)) ||
+            (type == AVMEDIA_TYPE_AUDIO && (want & DEMUX_WANT_AUDIO))) {
+            st->discard = AVDISCARD_DEFAULT;
+        } else {
+            st->discard = AVDISCARD_ALL;
+            if (type == AVMEDIA_TYPE_VIDEO) {
+                probed &= ~DEMUX_WANT_VIDEO;
+            } else if (type == AVMEDIA_TYPE_AUDIO) {
+                probed &= ~DEMUX_WANT_AUDIO;
+            }
+        }
+    }
+    return probed;
+}
+
+static char *
+stream_cache_path(const char *filename) {
+    size_t len = strlen(filename);
+    char *path = malloc(len + sizeof(".streams"));
+    if (path != NULL) {
+        memcpy(path, filename, len);
+        memcpy(path + len, ".streams", sizeof(".streams"));
+    }
+    return path;
+}
+
+static int
+stream_cache_file_info(const char *filename, int64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(filename, &st) < 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+// 读缓存并填到流参数里，缓存不存在、过期、和文件对不上或者没有探测过 want 里的流类型返回 -1
+static int
+stream_cache_load(AVFormatContext *fmt_ctx, const char *filename, int want) {
+    int64_t file_size, file_mtime;
+    if (stream_cache_file_info(filename, &file_size, &file_mtime) < 0) {
+        return -1;
+    }
+    char *path = stream_cache_path(filename);
+    FILE *f = path != NULL ? fopen(path, "rb") : NULL;
+    free(path);
+    if (f == NULL) {
+        return -1;
+    }
+
+    int ret = -1;
+    StreamCacheHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != STREAM_CACHE_MAGIC ||
+        header.file_size != file_size || header.file_mtime != file_mtime ||
+        header.nb_streams != fmt_ctx->nb_streams || (header.want & want) != want) {
+        goto end;
+    }
+
+    // 先全部读出来检查一遍，对得上再修改流参数
+    StreamCacheEntry *entries = calloc(header.nb_streams, sizeof(StreamCacheEntry));
+    uint8_t **extradata = calloc(header.nb_streams, sizeof(uint8_t *));
+    if (entries == NULL || extradata == NULL) {
+        free(entries);
+        free(extradata);
+        goto end;
+    }
+    int64_t i;
+    for (i = 0; i < header.nb_streams; i++) {
+        StreamCacheEntry *e = &entries[i];
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (fread(e, sizeof(*e), 1, f) != 1 || e->codec_type != par->codec_type ||
+            (par->codec_id != AV_CODEC_ID_NONE && e->codec_id != par->codec_id) || e->extradata_size < 0 ||
+            e->extradata_size > 16 * 1024 * 1024) {
+            break;
+        }
+        if (e->extradata_size > 0) {
+            extradata[i] = av_mallocz(e->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (extradata[i] == NULL || fread(extradata[i], e->extradata_size, 1, f) != 1) {
+                break;
+            }
+        }
+    }
+
+    if (i == header.nb_streams) {
+        for (i = 0; i < header.nb_streams; i++) {
+            StreamCacheEntry *e = &entries[i];
+            AVStream *st = fmt_ctx->streams[i];
+            AVCodecParameters *par = st->codecpar;
+            par->codec_id = e->codec_id;
+            par->format = e->format;
+            par->width = e->width;
+            par->height = e->height;
+            par->sample_aspect_ratio = (AVRational){e->sample_aspect_ratio_num, e->sample_aspect_ratio_den};
+            par->sample_rate = e->sample_rate;
+            par->channels = e->channels;
+            par->channel_layout = e->channel_layout;
+            par->frame_size = e->frame_size;
+            st->time_base = (AVRational){e->time_base_num, e->time_base_den};
+            st->r_frame_rate = (AVRational){e->r_frame_rate_num, e->r_frame_rate_den};
+            st->avg_frame_rate = (AVRational){e->avg_frame_rate_num, e->avg_frame_rate_den};
+            st->start_time = e->start_time;
+            st->duration = e->duration;
+            // 解复用器自己读到了 extradata 就用它的
+            if (extradata[i] != NULL && par->extradata == NULL) {
+                par->extradata = extradata[i];
+                par->extradata_size = e->extradata_size;
+                extradata[i] = NULL;
+            }
+        }
+        fmt_ctx->start_time = header.start_time;
+        fmt_ctx->duration = header.duration;
+        fmt_ctx->bit_rate = header.bit_rate;
+        ret = 0;
+    }
+    for (i = 0; i < header.nb_streams; i++) {
+        av_free(extradata[i]);
+    }
+    free(extradata);
+    free(entries);
+
+end:
+    fclose(f);
+    return ret;
+}
+
+// 保存流参数，probed 是探测过的流类型，写不了（比如目录只读）就算了，下次还是正常探测
+static void
+stream_cache_save(const AVFormatContext *fmt_ctx, const char *filename, int probed) {
+    StreamCacheHeader header = {
+        .magic = STREAM_CACHE_MAGIC,
+        .want = probed,
+        .nb_streams = fmt_ctx->nb_streams,
+        .start_time = fmt_ctx->start_time,
+        .duration = fmt_ctx->duration,
+        .bit_rate = fmt_ctx->bit_rate,
+    };
+    if (stream_cache_file_info(filename, &header.file_size, &header.file_mtime) < 0) {
+        return;
+    }
+    char *path = stream_cache_path(filename);
+    FILE *f = path != NULL ? fopen(path, "wb") : NULL;
+    free(path);
+    if (f == NULL) {
+        return;
+    }
+
+    fwrite(&header, sizeof(header), 1, f);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        const AVStream *st = fmt_ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        StreamCacheEntry e = {
+            .codec_type = par->codec_type,
+            .codec_id = par->codec_id,
+            .format = par->format,
+            .width = par->width,
+            .height = par->height,
+            .sample_aspect_ratio_num = par->sample_aspect_ratio.num,
+            .sample_aspect_ratio_den = par->sample_aspect_ratio.den,
+            .sample_rate = par->sample_rate,
+            .channels = par->channels,
+            .channel_layout = par->channel_layout,
+            .frame_size = par->frame_size,
+            .time_base_num = st->time_base.num,
+            .time_base_den = st->time_base.den,
+            .r_frame_rate_num = st->r_frame_rate.num,
+            .r_frame_rate_den = st->r_frame_rate.den,
+            .avg_frame_rate_num = st->avg_frame_rate.num,
+            .avg_frame_rate_den = st->avg_frame_rate.den,
+            .start_time = st->start_time,
+            .duration = st->duration,
+            .extradata_size = par->extradata != NULL ? par->extradata_size : 0,
+        };
+        fwrite(&e, sizeof(e), 1, f);
+        if (e.extradata_size > 0) {
+            fwrite(par->extradata, e.extradata_size, 1, f);
+        }
+    }
+    fclose(f);
+}
+
+int
+demux_find_stream_info(AVFormatContext *fmt_ctx, const char *filename, const ProbeOptions *opts, int want,
+                       StartupTimer *timer) {
+    if (timer != NULL) {
+        timer->opened = av_gettime_relative();
+    }
+
+    int ret = 0;
+    const char *source = "probe";
+    if (opts->use_cache && stream_cache_load(fmt_ctx, filename, want) == 0) {
+        source = "cache";
+    } else if (opts->fast && wanted_streams_complete(fmt_ctx, want)) {
+        // 文件头里已经有需要的参数（比如 mp4 / mkv），字幕之类用不到的流不再等
+        source = "header";
+    } else {
+        if (opts->fast) {
+            fmt_ctx->probesize = PROBE_FAST_SIZE;
+            fmt_ctx->max_analyze_duration = PROBE_FAST_DURATION;
+        }
+        if (opts->probesize > 0) {
+            fmt_ctx->probesize = opts->probesize;
+        }
+        if (opts->analyzeduration > 0) {
+            fmt_ctx->max_analyze_duration = opts->analyzeduration;
+        }
+        // 快速启动时用不到的流不探测，缓存里记下探测了哪些流类型，需要其他流的程序读缓存时会重新探测
+        int probed = DEMUX_WANT_VIDEO | DEMUX_WANT_AUDIO;
+        if (opts->fast) {
+            probed = discard_unwanted_streams(fmt_ctx, want);
+        }
+        ret = avformat_find_stream_info(fmt_ctx, NULL);
+        if (ret >= 0 && opts->use_cache) {
+            stream_cache_save(fmt_ctx, filename, probed);
+        }
+    }
+
+    if (timer != NULL) {
+        timer->probed = av_gettime_relative();
+        printf("stream info from %s in %.1f ms\n", source, (timer->probed - timer->opened) / 1000.0);
+    }
+    return ret;
+}
+
+void
+startup_timer_init(StartupTimer *timer) {
+    *timer = (StartupTimer){0};
+    timer->start = av_gettime_relative();
+}
+
+void
+startup_timer_first_frame(StartupTimer *timer) {
+    if (timer->first_frame != 0) {
+        return;
+    }
+    timer->first_frame = av_gettime_relative();
+    printf("time to first frame: %.1f ms (open %.1f ms, stream info %.1f ms, decode %.1f ms)\n",
+           (timer->first_frame - timer->start) / 1000.0, (timer->opened - timer->start) / 1000.0,
+           (timer->probed - timer->opened) / 1000.0, (timer->first_frame - timer->probed) / 1000.0);
+}
@@ -0,0 +1,86 @@
+#ifndef COMMON_DEMUX_H
+#define COMMON_DEMUX_H
+
+#include <libavformat/avformat.h>
+
+// 统计解复用读了多少数据，有多少真正交给了解码器
+typedef struct DemuxStats {
+    int64_t packets;
+    int64_t packet_bytes;
+    int64_t used_packets;
+    int64_t used_bytes;
+} DemuxStats;
+
+// 只保留 video_stream_index 和 audio_stream_index 两路流（不需要的传 -1）
+// 其他流设为 AVDISCARD_ALL，解复用时直接跳过，av_read_frame 不会再返回它们的 packet
+void
+demux_keep_streams(AVFormatContext *fmt_ctx, int video_stream_index, int audio_stream_index);
+
+void
+demux_stats_init(DemuxStats *stats);
+
+// 每读到一个 packet 调用一次，used 表示这个 packet 送给了解码器
+static inline void
+demux_stats_packet(DemuxStats *stats, const AVPacket *packet, int used) {
+    stats->packets += 1;
+    stats->packet_bytes += packet->size;
+    if (used) {
+        stats->used_packets += 1;
+        stats->used_bytes += packet->size;
+    }
+}
+
+// 打印从文件读了多少字节，其中多少字节是用到的
+void
+demux_stats_print(const DemuxStats *stats, const AVFormatContext *fmt_ctx);
+
+// 程序需要哪些类型的流，快速启动时只等这些流的参数
+#define DEMUX_WANT_VIDEO 1
+#define DEMUX_WANT_AUDIO 2
+
+// 快速启动模式下 avformat_find_stream_info 最多读的字节数和时长（微秒）
+#define PROBE_FAST_SIZE (512 * 1024)
+#define PROBE_FAST_DURATION 500000
+
+// 获取流信息的配置
+// 可以用环境变量 FAST_START=1 / STREAM_CACHE=1
+// 或者命令行参数 --fast-start / --probesize=BYTES / --analyzeduration=US / --stream-cache 修改
+typedef struct ProbeOptions {
+    // 限制探测的数据量，需要的流参数已经完整时直接跳过探测
+    int fast;
+    // 大于 0 时覆盖默认值
+    int64_t probesize;
+    int64_t analyzeduration;
+    // 把流参数保存到 <文件名>.streams，下次打开同一个文件时直接使用
+    int use_cache;
+} ProbeOptions;
+
+// 统计从启动到第一帧的时间
+typedef struct StartupTimer {
+    int64_t start;
+    int64_t opened;
+    int64_t probed;
+    int64_t first_frame;
+} StartupTimer;
+
+// 用环境变量初始化配置，然后从 argv 里取出探测相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+probe_parse_args(ProbeOptions *opts, int argc, const char **argv);
+
+// 代替 avformat_find_stream_info，want 是 DEMUX_WANT_VIDEO / DEMUX_WANT_AUDIO 的组合
+// 快速启动需要探测时先把 want 以外的流设成 AVDISCARD_ALL，不解码它们
+// timer 不为 NULL 时记录打开文件和探测结束的时间
+int
+demux_find_stream_info(AVFormatContext *fmt_ctx, const char *filename, const ProbeOptions *opts, int want,
+                       StartupTimer *timer);
+
+// 程序开始时调用
+void
+startup_timer_init(StartupTimer *timer);
+
+// 第一帧显示（或者保存）时调用，只有第一次会记录并打印
+void
+startup_timer_first_frame(StartupTimer *timer);
+
+#endif
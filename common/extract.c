@@ -0,0 +1,470 @@
+#include "extract.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "media.h"
+#include "scene_detect.h"
+#include "seek_index.h"
+
+int
+extract_mode_from_name(const char *name) {
+    if (strcmp(name, "decode") == 0) {
+        return EXTRACT_DECODE;
+    } else if (strcmp(name, "seek") == 0) {
+        return EXTRACT_SEEK;
+    } else if (strcmp(name, "key") == 0) {
+        return EXTRACT_KEY;
+    } else if (strcmp(name, "scene") == 0) {
+        return EXTRACT_SCENE;
+    }
+    return -1;
+}
+
+int
+extract_parse_args(ExtractOptions *opts, int argc, const char **argv) {
+    opts->mode = EXTRACT_DECODE;
+    // 0 表示按模式取默认值
+    opts->interval = 0;
+    opts->scene_threshold = SCENE_THRESHOLD;
+    opts->output_prefix = "";
+    opts->verbose = 1;
+    argc = decoder_parse_args(&opts->decoder, argc, argv);
+    argc = probe_parse_args(&opts->probe, argc, argv);
+    argc = file_io_parse_args(&opts->io, argc, argv);
+    argc = thumbnail_parse_args(&opts->thumb, argc, argv);
+    argc = sprite_parse_args(&opts->sprite, argc, argv);
+    if (opts->sprite.cols > 0 && opts->thumb.width == 0 && opts->thumb.height == 0) {
+        opts->thumb.width = SPRITE_TILE_WIDTH;
+    }
+    if (opts->thumb.lowres) {
+        opts->decoder.lowres_width = opts->thumb.width;
+        opts->decoder.lowres_height = opts->thumb.height;
+    }
+    return argc;
+}
+
+static int
+save_frame(uint8_t *buf, int linesize, int width, int height, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (size_t i = 0; i < height; i++) {
+        fwrite(buf + i * linesize, 1, width * 3, file);
+    }
+    int ret = ferror(file) ? -1 : 0;
+    if (fclose(file) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// 从当前读取位置开始解码，直到拿到 pts >= target 的帧，结果放在 frame 里
+// target 为 AV_NOPTS_VALUE 时直接返回解码出的第一帧
+// 读到文件末尾时会把解码器里缓存的帧也取出来，全部取完后返回 AVERROR_EOF
+static int
+decode_until(AVFormatContext *fmt_ctx, Decoder *dec, AVPacket *packet, AVFrame *frame, int64_t target) {
+    int ret;
+    while (1) {
+        ret = decoder_receive_frame(dec, frame);
+        if (ret == 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (target == AV_NOPTS_VALUE || pts == AV_NOPTS_VALUE || pts >= target) {
+                return 0;
+            }
+            // 还没到目标时间，丢掉这一帧继续解码
+            continue;
+        } else if (ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+
+        // 解码器需要更多的 packet
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，发送 NULL 让解码器吐出缓存的帧
+            ret = decoder_send_packet(dec, NULL);
+        } else if (packet->stream_index != dec->stream_index) {
+            av_packet_unref(packet);
+            continue;
+        } else {
+            ret = decoder_send_packet(dec, packet);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+// 一个文件处理过程中的全部状态，选中的帧由 output_frame 保存
+typedef struct Extractor {
+    const ExtractOptions *opts;
+    const char *filename;
+    AVRational time_base;
+    // 流中途改变分辨率时按新参数取转换上下文，输出大小不变
+    // 输出图像的内存从转换器的池里取，每张图写完就还回去
+    VideoConverter converter;
+    AVFrame *frame_rgb;
+    // 开启 --sprite 时选中的帧都拼到雪碧图里，不再单独写 ppm
+    SpriteSheet sprite;
+    int use_sprite;
+    StartupTimer startup;
+    int frame_count;
+} Extractor;
+
+static int
+output_frame(Extractor *e, AVFrame *frame, int64_t pts) {
+    e->frame_count += 1;
+    if (e->use_sprite) {
+        double time = pts != AV_NOPTS_VALUE ? pts * av_q2d(e->time_base) : 0;
+        if (sprite_sheet_add(&e->sprite, frame, time) < 0) {
+            printf("Could not add frame to sprite sheet\n");
+            return -1;
+        }
+    } else {
+        // 缩放和 yuv -> rgb 在同一次转换里完成
+        if (video_converter_convert(&e->converter, frame, e->frame_rgb) < 0) {
+            printf("Could not convert frame\n");
+            return -1;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%sframe_%d.ppm", e->opts->output_prefix, e->frame_count);
+        int ret = save_frame(e->frame_rgb->data[0], e->frame_rgb->linesize[0], e->frame_rgb->width,
+                             e->frame_rgb->height, path);
+        av_frame_unref(e->frame_rgb);
+        if (ret < 0) {
+            printf("Could not write %s\n", path);
+            return -1;
+        }
+    }
+    if (e->opts->verbose) {
+        startup_timer_first_frame(&e->startup);
+    }
+    return 0;
+}
+
+// 从当前读取位置往后读 packet，找 stream_index 流里 pts 大于 after 的下一个关键帧，读到文件末尾返回 AV_NOPTS_VALUE
+// 只读不解码，key 模式重复落在同一个关键帧上时用来判断后面还有没有关键帧
+static int64_t
+next_key_pts(AVFormatContext *fmt_ctx, int stream_index, AVPacket *packet, int64_t after) {
+    while (av_read_frame(fmt_ctx, packet) >= 0) {
+        int64_t pts = packet->pts;
+        int found = packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY) &&
+                    pts != AV_NOPTS_VALUE && pts > after;
+        av_packet_unref(packet);
+        if (found) {
+            return pts;
+        }
+    }
+    return AV_NOPTS_VALUE;
+}
+
+// 返回 next 之前的最后一个目标时间点，循环加上 delta 以后就是第一个落在 next 这个关键帧上的目标
+static int64_t
+target_before(int64_t target, int64_t next, int64_t delta) {
+    if (next <= target || delta <= 0) {
+        return target;
+    }
+    return target + (next - target - 1) / delta * delta;
+}
+
+// seek 和 key 模式：按间隔 seek 到每个目标时间点
+// 不知道时长时循环没有上限，key 模式靠下一个关键帧是否存在判断结束，seek 模式目标超过最后一帧时解码返回 EOF
+static int
+extract_seek(Extractor *e, AVFormatContext *fmt_ctx, Decoder *dec, AVPacket *packet, AVFrame *frame, int64_t delta) {
+    const ExtractOptions *opts = e->opts;
+    int stream_index = dec->stream_index;
+    AVStream *video_stream = dec->stream;
+    // 起止时间，单位是 time_base
+    int64_t start = video_stream->start_time != AV_NOPTS_VALUE ? video_stream->start_time : 0;
+    int64_t duration = video_stream->duration;
+    if (duration == AV_NOPTS_VALUE && fmt_ctx->duration != AV_NOPTS_VALUE) {
+        duration = av_rescale_q(fmt_ctx->duration, AV_TIME_BASE_Q, e->time_base);
+    }
+
+    // 有 tools/seek_index 生成的索引时，直接在索引里二分查找关键帧
+    SeekIndex *seek_index = seek_index_open(e->filename);
+    if (seek_index != NULL && opts->verbose) {
+        printf("using seek index %s.idx\n", e->filename);
+    }
+
+    int ret = 0;
+    int64_t last_pts = 0;
+    int first_frame = 1;
+    for (int64_t target = start; duration == AV_NOPTS_VALUE || target < start + duration; target += delta) {
+        if (seek_index != NULL) {
+            // key 模式只要关键帧，和上一张是同一个关键帧就不用再 seek 和解码了
+            const SeekIndexEntry *key = seek_index_find_key(seek_index, stream_index, target);
+            if (opts->mode == EXTRACT_KEY && key != NULL && !first_frame && key->pts == last_pts) {
+                int64_t key_count;
+                const SeekIndexEntry *keys = seek_index_keys(seek_index, stream_index, &key_count);
+                if (key == keys + key_count - 1) {
+                    // 最后一个关键帧已经保存过了，后面的目标都会落在它上面
+                    break;
+                }
+                // 中间的目标都落在这个关键帧上，直接跳到下一个关键帧
+                target = target_before(target, key[1].pts, delta);
+                continue;
+            }
+            int64_t key_pts;
+            ret = seek_index_seek(seek_index, fmt_ctx, stream_index, target, &key_pts);
+        } else {
+            // max_ts 设为 target，seek 到 target 之前（含）最近的关键帧
+            ret = avformat_seek_file(fmt_ctx, stream_index, INT64_MIN, target, target, 0);
+        }
+        if (ret < 0) {
+            // 后面的时间点也 seek 不到，已经保存的图片还是有效的
+            printf("Could not seek to %lld\n", (long long)target);
+            ret = 0;
+            break;
+        }
+        // seek 之后解码器里还有旧位置的数据，需要清空，上一次读到文件末尾排空过的解码器也能继续用
+        decoder_flush(dec);
+
+        ret = decode_until(fmt_ctx, dec, packet, frame, opts->mode == EXTRACT_KEY ? AV_NOPTS_VALUE : target);
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            printf("Error decoding\n");
+            break;
+        }
+
+        // 关键帧间隔比抽帧间隔长时，key 模式可能多次落在同一个关键帧上
+        int64_t pts = frame->best_effort_timestamp;
+        if (!first_frame && pts == last_pts) {
+            if (opts->mode == EXTRACT_KEY && pts != AV_NOPTS_VALUE) {
+                // 往后读 packet 找下一个关键帧，读到文件末尾还没有说明已经是最后一个关键帧
+                // 不能靠 seek 判断结束：目标超过最后一个关键帧以后每次 seek 都落回它上面
+                int64_t next = next_key_pts(fmt_ctx, stream_index, packet, last_pts);
+                if (next == AV_NOPTS_VALUE) {
+                    break;
+                }
+                target = target_before(target, next, delta);
+            }
+            continue;
+        }
+        last_pts = pts;
+        first_frame = 0;
+        ret = output_frame(e, frame, pts);
+        if (ret < 0) {
+            break;
+        }
+    }
+    seek_index_close(&seek_index);
+    return ret;
+}
+
+// decode 和 scene 模式：解码全部帧，按间隔或者镜头切换挑出需要的帧
+static int
+extract_decode(Extractor *e, AVFormatContext *fmt_ctx, Decoder *dec, AVPacket *packet, AVFrame *frame, int64_t delta) {
+    const ExtractOptions *opts = e->opts;
+    // scene 模式在解码出的 yuv 上直接算签名，只有选中的帧才转换成 rgb
+    SceneDetector scene;
+    scene_detector_init(&scene);
+    // 检测到了镜头切换但是那一帧太暗，等到第一个不黑的帧再取
+    int scene_pending = 1;
+    int64_t last_pts = 0;
+    int first_frame = 1;
+
+    int ret = 0;
+    int done = 0;
+    while (!done) {
+        ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完了，发送 NULL 让解码器把缓存的帧都吐出来
+            ret = decoder_send_packet(dec, NULL);
+        } else if (packet->stream_index != dec->stream_index) {
+            // 只要视频的包
+            av_packet_unref(packet);
+            continue;
+        } else {
+            // 解码视频帧，packet 的数据交给解码器，packet 继续用来读下一个
+            ret = decoder_send_packet(dec, packet);
+        }
+        if (ret < 0) {
+            printf("Error decoding\n");
+            break;
+        }
+
+        // 一个包里可能有多个视频帧，都读出来保存图片
+        while (1) {
+            ret = decoder_receive_frame(dec, frame);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = 0;
+                break;
+            } else if (ret == AVERROR_EOF) {
+                // 排空结束，解码器里的帧都取完了
+                ret = 0;
+                done = 1;
+                break;
+            } else if (ret < 0) {
+                printf("Error decoding\n");
+                break;
+            }
+
+            int64_t pts = frame->pts;
+            if (opts->mode == EXTRACT_SCENE) {
+                double score, luma;
+                if (scene_detector_frame(&scene, frame, &score, &luma) < 0) {
+                    printf("Could not compute frame signature\n");
+                    ret = -1;
+                    break;
+                }
+                // 离上一张太近的切换不要，避免快速剪辑时连续出很多张
+                if (score >= opts->scene_threshold &&
+                    (first_frame || pts == AV_NOPTS_VALUE || pts - last_pts >= delta)) {
+                    scene_pending = 1;
+                }
+                if (!scene_pending || luma < SCENE_BLACK_LUMA) {
+                    continue;
+                }
+                if (opts->verbose) {
+                    printf("scene at %.3fs, score %.3f\n", pts * av_q2d(e->time_base), score);
+                }
+                scene_pending = 0;
+                last_pts = pts;
+                first_frame = 0;
+            } else if (first_frame || pts - last_pts > delta) {
+                last_pts = frame->pts;
+                first_frame = 0;
+            } else {
+                continue;
+            }
+
+            ret = output_frame(e, frame, pts);
+            if (ret < 0) {
+                break;
+            }
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+    scene_detector_free(&scene);
+    return ret;
+}
+
+int
+extract_frames(const char *filename, const ExtractOptions *opts, ExtractResult *result) {
+    Extractor e = {
+        .opts = opts,
+        .filename = filename,
+    };
+    startup_timer_init(&e.startup);
+    int ret;
+    MediaSource source = {0};
+    Decoder decoder = {0};
+    AVFrame *frame = NULL;
+    AVPacket *packet = NULL;
+    DecodeStats decode_stats;
+    decode_stats_init(&decode_stats);
+
+    // 打开视频文件，按 --io 参数选择读文件的方式，获取 stream 信息，找到视频流
+    // 只要视频流，其他流的 packet 解复用时就跳过
+    ret = media_source_open(&source, filename, &opts->io, &opts->probe, DEMUX_WANT_VIDEO,
+                            opts->verbose ? &e.startup : NULL);
+    if (ret < 0) {
+        goto end;
+    }
+    AVFormatContext *fmt_ctx = source.fmt_ctx;
+    int video_stream_index = source.video_index;
+    if (opts->verbose) {
+        av_dump_format(fmt_ctx, 0, filename, 0);
+    }
+    e.time_base = fmt_ctx->streams[video_stream_index]->time_base;
+
+    // 找到视频流的解码器，配置好多线程后打开，不打印统计时也不打印解码器的配置
+    DecoderOptions decoder_opts = opts->decoder;
+    decoder_opts.quiet = !opts->verbose;
+    ret = decoder_open(&decoder, fmt_ctx, video_stream_index, &decoder_opts);
+    if (ret < 0) {
+        goto end;
+    }
+    AVCodecContext *codec_ctx = decoder.codec_ctx;
+
+    // key 模式只需要关键帧，让解码器直接丢掉非关键帧
+    if (opts->mode == EXTRACT_KEY) {
+        codec_ctx->skip_frame = AVDISCARD_NONKEY;
+    }
+
+    // 保存解码出的 frame，是 yuv 格式的图片
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    // 用来保存 yuv -> rgb 图像，大小是缩略图的大小
+    e.frame_rgb = av_frame_alloc();
+    if (frame == NULL || packet == NULL || e.frame_rgb == NULL) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    int out_width, out_height;
+    thumbnail_size(&opts->thumb, codec_ctx->width, codec_ctx->height, codec_ctx->sample_aspect_ratio, &out_width,
+                   &out_height);
+
+    if (opts->sprite.cols > 0) {
+        char prefix[SPRITE_PATH_SIZE];
+        snprintf(prefix, sizeof(prefix), "%s%s", opts->output_prefix, opts->sprite.prefix);
+        ret = sprite_sheet_open(&e.sprite, prefix, opts->sprite.cols, opts->sprite.rows, out_width, out_height,
+                                opts->sprite.format, opts->thumb.flags, opts->verbose);
+        if (ret < 0) {
+            printf("Could not create sprite sheet %s\n", prefix);
+            goto end;
+        }
+        e.use_sprite = 1;
+    } else {
+        ret = video_converter_init(&e.converter, out_width, out_height, AV_PIX_FMT_RGB24, opts->thumb.flags);
+        if (ret < 0) {
+            printf("Could not create converter\n");
+            goto end;
+        }
+    }
+
+    int interval = opts->interval;
+    if (interval <= 0) {
+        interval = opts->mode == EXTRACT_SCENE ? SCENE_MIN_INTERVAL : EXTRACT_INTERVAL;
+    }
+    int64_t delta = av_rescale_q(interval, (AVRational){1, 1}, e.time_base);
+    if (opts->mode == EXTRACT_SEEK || opts->mode == EXTRACT_KEY) {
+        ret = extract_seek(&e, fmt_ctx, &decoder, packet, frame, delta);
+    } else {
+        ret = extract_decode(&e, fmt_ctx, &decoder, packet, frame, delta);
+    }
+
+    if (opts->verbose) {
+        printf("saved %d frames, decoded %lld frames\n", e.frame_count, (long long)decoder.frames_out);
+        decode_stats.frames = decoder.frames_out;
+        decode_stats_print(&decode_stats, "video");
+        decoder_print_stats(&decoder, "video");
+    }
+
+end:
+    if (e.use_sprite) {
+        // 最后一格一直显示到视频结束
+        double end_time = media_source_duration(&source);
+        if (sprite_sheet_close(&e.sprite, end_time > 0 ? end_time : -1) > 0 && ret >= 0) {
+            ret = -1;
+        }
+    }
+    if (result != NULL) {
+        result->frames_saved = e.frame_count;
+        result->frames_decoded = decoder.frames_out;
+        result->bytes_read = media_source_bytes_read(&source);
+        result->duration = media_source_duration(&source);
+    }
+    // 清理分配的资源
+    video_converter_free(&e.converter);
+    av_frame_free(&e.frame_rgb);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    decoder_close(&decoder);
+    if (opts->verbose) {
+        file_io_print_stats(source.io);
+    }
+    media_source_close(&source);
+    return ret;
+}
@@ -0,0 +1,71 @@
+#ifndef COMMON_EXTRACT_H
+#define COMMON_EXTRACT_H
+
+#include <stdint.h>
+
+#include "decoder.h"
+#include "demux.h"
+#include "file_io.h"
+#include "sprite_sheet.h"
+#include "thumbnail.h"
+
+// 从一个视频文件里抽帧保存成图片，1/1s1f.c 和 tools/batch.c 共用
+// 出错时释放这个文件用到的全部资源后返回负数，不会退出进程，批量处理时一个文件失败不影响其他文件
+
+// 抽帧模式
+// decode: 解码全部帧，按时间间隔挑出需要的帧
+// seek: 每个目标时间点先 seek 到之前最近的关键帧，只解码到目标时间
+// key: 只取 seek 到的关键帧，不往后解码，速度最快但时间不精确
+// scene: 解码全部帧，在镜头切换的地方取帧，跳过黑屏，间隔参数是两张图之间的最小间隔
+typedef enum ExtractMode {
+    EXTRACT_DECODE,
+    EXTRACT_SEEK,
+    EXTRACT_KEY,
+    EXTRACT_SCENE,
+} ExtractMode;
+
+// scene 模式默认的切换分数阈值和最小间隔（秒）
+#define SCENE_THRESHOLD 0.2
+#define SCENE_MIN_INTERVAL 2
+// 其他模式默认的抽帧间隔（秒）
+#define EXTRACT_INTERVAL 60
+
+typedef struct ExtractOptions {
+    ExtractMode mode;
+    // 抽帧间隔，scene 模式下是最小间隔，单位秒
+    int interval;
+    double scene_threshold;
+    // 输出文件名的前缀，可以带目录，图片是 <output_prefix>frame_1.ppm，雪碧图是 <output_prefix><sprite.prefix>_1.jpg
+    const char *output_prefix;
+    // 为 0 时不打印文件信息、每一帧的信息和统计，批量处理时用
+    int verbose;
+    DecoderOptions decoder;
+    ProbeOptions probe;
+    FileIOOptions io;
+    ThumbnailOptions thumb;
+    SpriteOptions sprite;
+} ExtractOptions;
+
+typedef struct ExtractResult {
+    int frames_saved;
+    int frames_decoded;
+    // 从文件读取的字节数
+    int64_t bytes_read;
+    // 文件的时长，单位秒，不知道时为 0
+    double duration;
+} ExtractResult;
+
+// 按名字取模式：decode / seek / key / scene，不认识返回 -1
+int
+extract_mode_from_name(const char *name);
+
+// 用环境变量初始化配置，然后从 argv 里取出解码、读文件、缩略图和雪碧图相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+extract_parse_args(ExtractOptions *opts, int argc, const char **argv);
+
+// 按 opts 处理一个文件，成功返回 0，result 可以为 NULL
+int
+extract_frames(const char *filename, const ExtractOptions *opts, ExtractResult *result);
+
+#endif
@@ -0,0 +1,233 @@
+#include "file_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// AVIOContext 的缓冲区大小，readahead 模式每次 pread 读这么多
+#define FILE_IO_BUFFER_SIZE (256 * 1024)
+// mmap 模式只是 memcpy，缓冲区不用太大
+#define FILE_IO_MMAP_BUFFER_SIZE (64 * 1024)
+
+static int
+parse_mode(const char *value) {
+    if (strcmp(value, "mmap") == 0) {
+        return FILE_IO_MMAP;
+    } else if (strcmp(value, "readahead") == 0) {
+        return FILE_IO_READAHEAD;
+    }
+    return FILE_IO_DEFAULT;
+}
+
+int
+file_io_parse_args(FileIOOptions *opts, int argc, const char **argv) {
+    opts->mode = FILE_IO_DEFAULT;
+    opts->readahead = FILE_IO_READAHEAD_WINDOW;
+
+    const char *env = getenv("FILE_IO_MODE");
+    if (env != NULL) {
+        opts->mode = parse_mode(env);
+    }
+    env = getenv("FILE_IO_READAHEAD_MB");
+    if (env != NULL) {
+        opts->readahead = atoll(env) * 1024 * 1024;
+    }
+
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--io=", 5) == 0) {
+            opts->mode = parse_mode(argv[i] + 5);
+        } else if (strncmp(argv[i], "--readahead-mb=", 15) == 0) {
+            opts->readahead = atoll(argv[i] + 15) * 1024 * 1024;
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    if (opts->readahead <= 0) {
+        opts->readahead = FILE_IO_READAHEAD_WINDOW;
+    }
+    return n;
+}
+
+static int
+mmap_read(void *opaque, uint8_t *buf, int buf_size) {
+    FileIO *io = opaque;
+    if (io->pos >= io->size) {
+        return AVERROR_EOF;
+    }
+    int64_t size = io->size - io->pos < buf_size ? io->size - io->pos : buf_size;
+    memcpy(buf, io->map + io->pos, size);
+    io->pos += size;
+    io->stats.bytes += size;
+    return size;
+}
+
+static int
+readahead_read(void *opaque, uint8_t *buf, int buf_size) {
+    FileIO *io = opaque;
+    // 读到窗口一半的时候请求预读下一段，内核在后台读，后面的 pread 直接命中页缓存
+    if (io->pos + io->readahead / 2 >= io->advised_end && io->advised_end < io->size) {
+        int64_t start = io->advised_end > io->pos ? io->advised_end : io->pos;
+        posix_fadvise(io->fd, start, io->pos + io->readahead - start, POSIX_FADV_WILLNEED);
+        io->advised_end = io->pos + io->readahead;
+        io->stats.advise_calls += 1;
+    }
+
+    ssize_t n = pread(io->fd, buf, buf_size, io->pos);
+    io->stats.read_calls += 1;
+    if (n < 0) {
+        return AVERROR(errno);
+    } else if (n == 0) {
+        return AVERROR_EOF;
+    }
+    io->pos += n;
+    io->stats.bytes += n;
+    return n;
+}
+
+static int64_t
+file_io_seek(void *opaque, int64_t offset, int whence) {
+    FileIO *io = opaque;
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+        return io->size;
+    }
+
+    int64_t pos;
+    if (whence == SEEK_SET) {
+        pos = offset;
+    } else if (whence == SEEK_CUR) {
+        pos = io->pos + offset;
+    } else if (whence == SEEK_END) {
+        pos = io->size + offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+    // 用 pread 读，seek 不需要系统调用，只是换个位置，预读窗口从新位置重新算
+    io->pos = pos;
+    io->advised_end = pos;
+    io->stats.seek_calls += 1;
+    return pos;
+}
+
+static int
+file_io_open(FileIO *io, const char *filename) {
+    io->fd = open(filename, O_RDONLY);
+    if (io->fd < 0) {
+        return AVERROR(errno);
+    }
+    struct stat st;
+    if (fstat(io->fd, &st) < 0) {
+        return AVERROR(errno);
+    }
+    io->size = st.st_size;
+
+    if (io->mode == FILE_IO_MMAP) {
+        if (io->size == 0) {
+            return AVERROR_INVALIDDATA;
+        }
+        io->map = mmap(NULL, io->size, PROT_READ, MAP_PRIVATE, io->fd, 0);
+        if (io->map == MAP_FAILED) {
+            io->map = NULL;
+            return AVERROR(errno);
+        }
+        // 大部分时候顺序读，让内核多预读一些
+        madvise(io->map, io->size, MADV_SEQUENTIAL);
+        io->stats.advise_calls += 1;
+    } else {
+        posix_fadvise(io->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        io->stats.advise_calls += 1;
+    }
+
+    int buffer_size = io->mode == FILE_IO_MMAP ? FILE_IO_MMAP_BUFFER_SIZE : FILE_IO_BUFFER_SIZE;
+    uint8_t *buffer = av_malloc(buffer_size);
+    if (buffer == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    io->avio = avio_alloc_context(buffer, buffer_size, 0, io, io->mode == FILE_IO_MMAP ? mmap_read : readahead_read,
+                                  NULL, file_io_seek);
+    if (io->avio == NULL) {
+        av_free(buffer);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+int
+file_io_open_input(AVFormatContext **fmt_ctx, const char *filename, const FileIOOptions *opts, FileIO **io) {
+    *io = NULL;
+    if (opts->mode == FILE_IO_DEFAULT) {
+        return avformat_open_input(fmt_ctx, filename, NULL, NULL);
+    }
+
+    FileIO *f = calloc(1, sizeof(FileIO));
+    if (f == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    f->fd = -1;
+    f->mode = opts->mode;
+    f->readahead = opts->readahead;
+    int ret = file_io_open(f, filename);
+    if (ret < 0) {
+        file_io_close(&f);
+        return ret;
+    }
+
+    AVFormatContext *ctx = *fmt_ctx != NULL ? *fmt_ctx : avformat_alloc_context();
+    if (ctx == NULL) {
+        file_io_close(&f);
+        return AVERROR(ENOMEM);
+    }
+    ctx->pb = f->avio;
+    ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    // 失败时 avformat_open_input 会释放 ctx，但不会释放自定义的 pb
+    ret = avformat_open_input(&ctx, filename, NULL, NULL);
+    if (ret < 0) {
+        *fmt_ctx = NULL;
+        file_io_close(&f);
+        return ret;
+    }
+    *fmt_ctx = ctx;
+    *io = f;
+    return 0;
+}
+
+void
+file_io_close(FileIO **io) {
+    FileIO *f = *io;
+    if (f == NULL) {
+        return;
+    }
+    if (f->avio != NULL) {
+        // 缓冲区可能被 avio 换过，要释放 avio 里记录的那个
+        av_freep(&f->avio->buffer);
+        avio_context_free(&f->avio);
+    }
+    if (f->map != NULL) {
+        munmap(f->map, f->size);
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+    }
+    free(f);
+    *io = NULL;
+}
+
+void
+file_io_print_stats(const FileIO *io) {
+    if (io == NULL) {
+        return;
+    }
+    const char *mode = io->mode == FILE_IO_MMAP ? "mmap" : "readahead";
+    printf("io %s: %lld bytes, %lld read calls, %lld seeks, %lld advise calls\n", mode, (long long)io->stats.bytes,
+           (long long)io->stats.read_calls, (long long)io->stats.seek_calls, (long long)io->stats.advise_calls);
+}
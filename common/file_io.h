@@ -0,0 +1,64 @@
+#ifndef COMMON_FILE_IO_H
+#define COMMON_FILE_IO_H
+
+#include <libavformat/avformat.h>
+
+// 打开输入文件的方式
+// default: libavformat 自带的 file 协议，每次 read 32KB
+// mmap: 整个文件映射到内存，读就是 memcpy，seek 只是改一下位置
+// readahead: 每次 pread 一大块，并用 posix_fadvise 让内核提前异步读后面的一个窗口
+enum {
+    FILE_IO_DEFAULT,
+    FILE_IO_MMAP,
+    FILE_IO_READAHEAD,
+};
+
+// 默认的预读窗口大小
+#define FILE_IO_READAHEAD_WINDOW (8 * 1024 * 1024)
+
+// 可以用环境变量 FILE_IO_MODE / FILE_IO_READAHEAD_MB
+// 或者命令行参数 --io=default|mmap|readahead / --readahead-mb=N 修改，命令行优先
+typedef struct FileIOOptions {
+    int mode;
+    int64_t readahead;
+} FileIOOptions;
+
+typedef struct FileIOStats {
+    int64_t read_calls;
+    int64_t seek_calls;
+    int64_t advise_calls;
+    int64_t bytes;
+} FileIOStats;
+
+typedef struct FileIO {
+    int fd;
+    int mode;
+    uint8_t *map;
+    int64_t size;
+    // 下一次读的位置
+    int64_t pos;
+    int64_t readahead;
+    // 已经请求内核预读到的位置
+    int64_t advised_end;
+    FileIOStats stats;
+    AVIOContext *avio;
+} FileIO;
+
+// 用环境变量初始化配置，然后从 argv 里取出 io 相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+file_io_parse_args(FileIOOptions *opts, int argc, const char **argv);
+
+// 代替 avformat_open_input，default 模式下 io 为 NULL
+// 成功返回 0，关闭时先 avformat_close_input 再 file_io_close
+int
+file_io_open_input(AVFormatContext **fmt_ctx, const char *filename, const FileIOOptions *opts, FileIO **io);
+
+void
+file_io_close(FileIO **io);
+
+// 打印系统调用次数和读取的字节数
+void
+file_io_print_stats(const FileIO *io);
+
+#endif
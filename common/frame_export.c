@@ -0,0 +1,293 @@
+#include "frame_export.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EXPORT_PATH_SIZE 256
+
+typedef struct ExportJob {
+    AVFrame *frame;
+    char path[EXPORT_PATH_SIZE];
+} ExportJob;
+
+struct FrameExporter {
+    ExportFormat format;
+    // 写完的 frame 放回这里，为 NULL 时释放
+    FramePool *frames;
+    pthread_t *threads;
+    int nb_threads;
+
+    // 多个工作线程一起取任务，用互斥锁保护的环形队列
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    ExportJob *jobs;
+    int capacity;
+    int head;
+    int count;
+    int finished;
+
+    // 统计，在 lock 保护下修改
+    int64_t images;
+    int64_t bytes;
+    int errors;
+    int64_t start;
+};
+
+int
+export_format_from_name(const char *name) {
+    if (strcmp(name, "ppm") == 0) {
+        return EXPORT_PPM;
+    } else if (strcmp(name, "png") == 0) {
+        return EXPORT_PNG;
+    } else if (strcmp(name, "jpg") == 0 || strcmp(name, "jpeg") == 0) {
+        return EXPORT_JPEG;
+    }
+    return -1;
+}
+
+const char *
+export_format_extension(ExportFormat format) {
+    switch (format) {
+    case EXPORT_PNG:
+        return "png";
+    case EXPORT_JPEG:
+        return "jpg";
+    default:
+        return "ppm";
+    }
+}
+
+enum AVPixelFormat
+export_format_pix_fmt(ExportFormat format) {
+    // mjpeg 编码器只接受全范围的 yuv
+    return format == EXPORT_JPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_RGB24;
+}
+
+static enum AVCodecID
+export_format_codec(ExportFormat format) {
+    switch (format) {
+    case EXPORT_PNG:
+        return AV_CODEC_ID_PNG;
+    case EXPORT_JPEG:
+        return AV_CODEC_ID_MJPEG;
+    default:
+        return AV_CODEC_ID_PPM;
+    }
+}
+
+// 每个工作线程有自己的编码器，图片大小变化时重新打开
+static AVCodecContext *
+open_encoder(ExportFormat format, const AVFrame *frame) {
+    AVCodec *codec = avcodec_find_encoder(export_format_codec(format));
+    if (codec == NULL) {
+        return NULL;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->width = frame->width;
+    ctx->height = frame->height;
+    ctx->pix_fmt = frame->format;
+    ctx->time_base = (AVRational){1, 25};
+    // 并行已经在图片之间做了，单个编码器不再开线程
+    ctx->thread_count = 1;
+    if (format == EXPORT_JPEG) {
+        // 固定质量，数值越小质量越好
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality = FF_QP2LAMBDA * 3;
+    }
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// 整个文件一次 write 写完
+static int
+write_file(const char *path, const uint8_t *data, int size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return close(fd);
+}
+
+static int
+encode_job(FrameExporter *e, AVCodecContext **ctx, AVPacket *packet, ExportJob *job) {
+    AVFrame *frame = job->frame;
+    if (*ctx == NULL || (*ctx)->width != frame->width || (*ctx)->height != frame->height) {
+        avcodec_free_context(ctx);
+        *ctx = open_encoder(e->format, frame);
+        if (*ctx == NULL) {
+            return -1;
+        }
+    }
+
+    frame->quality = (*ctx)->global_quality;
+    int ret = avcodec_send_frame(*ctx, frame);
+    if (ret < 0) {
+        return ret;
+    }
+    // 图片编码器每一帧都直接输出一个完整的文件
+    ret = avcodec_receive_packet(*ctx, packet);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = write_file(job->path, packet->data, packet->size);
+    if (ret == 0) {
+        pthread_mutex_lock(&e->lock);
+        e->bytes += packet->size;
+        pthread_mutex_unlock(&e->lock);
+    }
+    av_packet_unref(packet);
+    return ret;
+}
+
+static void *
+export_thread(void *arg) {
+    FrameExporter *e = arg;
+    AVCodecContext *ctx = NULL;
+    AVPacket *packet = av_packet_alloc();
+
+    while (1) {
+        pthread_mutex_lock(&e->lock);
+        while (e->count == 0 && !e->finished) {
+            pthread_cond_wait(&e->not_empty, &e->lock);
+        }
+        if (e->count == 0) {
+            pthread_mutex_unlock(&e->lock);
+            break;
+        }
+        ExportJob job = e->jobs[e->head];
+        e->head = (e->head + 1) % e->capacity;
+        e->count -= 1;
+        pthread_cond_signal(&e->not_full);
+        pthread_mutex_unlock(&e->lock);
+
+        int ret = encode_job(e, &ctx, packet, &job);
+        if (e->frames != NULL) {
+            frame_pool_put(e->frames, &job.frame);
+        } else {
+            av_frame_free(&job.frame);
+        }
+
+        pthread_mutex_lock(&e->lock);
+        if (ret < 0) {
+            printf("Could not export %s\n", job.path);
+            e->errors += 1;
+        } else {
+            e->images += 1;
+        }
+        pthread_mutex_unlock(&e->lock);
+    }
+
+    avcodec_free_context(&ctx);
+    av_packet_free(&packet);
+    return NULL;
+}
+
+FrameExporter *
+frame_exporter_create(ExportFormat format, int workers, int queue_size, FramePool *frames) {
+    FrameExporter *e = calloc(1, sizeof(FrameExporter));
+    if (e == NULL) {
+        return NULL;
+    }
+    if (workers <= 0) {
+        workers = av_cpu_count();
+    }
+    if (queue_size <= 0) {
+        queue_size = workers * 2;
+    }
+    e->format = format;
+    e->frames = frames;
+    e->capacity = queue_size;
+    e->jobs = calloc(queue_size, sizeof(ExportJob));
+    e->threads = calloc(workers, sizeof(pthread_t));
+    if (e->jobs == NULL || e->threads == NULL) {
+        free(e->jobs);
+        free(e->threads);
+        free(e);
+        return NULL;
+    }
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->not_empty, NULL);
+    pthread_cond_init(&e->not_full, NULL);
+    e->start = av_gettime_relative();
+
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&e->threads[i], NULL, export_thread, e) != 0) {
+            break;
+        }
+        e->nb_threads += 1;
+    }
+    if (e->nb_threads == 0) {
+        frame_exporter_finish(e, 0);
+        return NULL;
+    }
+    return e;
+}
+
+int
+frame_exporter_submit(FrameExporter *e, AVFrame *frame, const char *path) {
+    pthread_mutex_lock(&e->lock);
+    // 队列满了说明编码跟不上解码，等一等，避免内存无限增长
+    while (e->count == e->capacity) {
+        pthread_cond_wait(&e->not_full, &e->lock);
+    }
+    ExportJob *job = &e->jobs[(e->head + e->count) % e->capacity];
+    job->frame = frame;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    e->count += 1;
+    pthread_cond_signal(&e->not_empty);
+    pthread_mutex_unlock(&e->lock);
+    return 0;
+}
+
+int
+frame_exporter_finish(FrameExporter *e, int verbose) {
+    pthread_mutex_lock(&e->lock);
+    e->finished = 1;
+    pthread_cond_broadcast(&e->not_empty);
+    pthread_mutex_unlock(&e->lock);
+    for (int i = 0; i < e->nb_threads; i++) {
+        pthread_join(e->threads[i], NULL);
+    }
+
+    if (verbose) {
+        double seconds = (av_gettime_relative() - e->start) / 1000000.0;
+        printf("export: %lld %s images, %lld bytes, %d errors, %d threads, %.2fs\n", (long long)e->images,
+               export_format_extension(e->format), (long long)e->bytes, e->errors, e->nb_threads, seconds);
+    }
+
+    int errors = e->errors;
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->not_empty);
+    pthread_cond_destroy(&e->not_full);
+    free(e->jobs);
+    free(e->threads);
+    free(e);
+    return errors;
+}
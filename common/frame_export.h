@@ -0,0 +1,46 @@
+#ifndef COMMON_FRAME_EXPORT_H
+#define COMMON_FRAME_EXPORT_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+#include "pool.h"
+
+// 把图片编码成文件的工作线程池
+// 解码线程只负责把转换好的 frame 放进队列，编码和写文件都在工作线程里完成
+typedef enum ExportFormat {
+    EXPORT_PPM,
+    EXPORT_PNG,
+    EXPORT_JPEG,
+} ExportFormat;
+
+typedef struct FrameExporter FrameExporter;
+
+// 按名字取格式：ppm / png / jpg，不认识返回 -1
+int
+export_format_from_name(const char *name);
+
+// 文件扩展名
+const char *
+export_format_extension(ExportFormat format);
+
+// 编码器需要的像素格式，提交的 frame 必须先转换成这个格式
+enum AVPixelFormat
+export_format_pix_fmt(ExportFormat format);
+
+// workers 为 0 时按 cpu 核数创建，queue_size 是最多排队的 frame 个数，为 0 时是 workers 的 2 倍
+// frames 不为 NULL 时工作线程写完图片把 frame 放回这个池，否则直接释放
+// 池的大小是 queue_size + workers 再加上调用方手里的 frame 时，导出过程中不再分配 frame
+FrameExporter *
+frame_exporter_create(ExportFormat format, int workers, int queue_size, FramePool *frames);
+
+// 提交一帧图片，frame 的所有权交给导出器
+// 队列满了会等待，成功返回 0
+int
+frame_exporter_submit(FrameExporter *e, AVFrame *frame, const char *path);
+
+// 等所有图片写完，verbose 不为 0 时打印统计，释放资源，返回出错的图片个数
+int
+frame_exporter_finish(FrameExporter *e, int verbose);
+
+#endif
@@ -0,0 +1,83 @@
+#include "media.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// 找 type 类型的流，没找到返回 -1
+// av_find_best_stream 在有多个同类流时优先选标记为默认的、码率和分辨率高的
+static int
+find_stream(AVFormatContext *fmt_ctx, enum AVMediaType type) {
+    int index = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
+    return index >= 0 ? index : -1;
+}
+
+int
+media_source_open(MediaSource *src, const char *filename, const FileIOOptions *io_opts, const ProbeOptions *probe_opts,
+                  int want, StartupTimer *timer) {
+    memset(src, 0, sizeof(*src));
+    src->video_index = -1;
+    src->audio_index = -1;
+
+    FileIOOptions default_io = {.mode = FILE_IO_DEFAULT};
+    int ret = file_io_open_input(&src->fmt_ctx, filename, io_opts != NULL ? io_opts : &default_io, &src->io);
+    if (ret < 0) {
+        printf("Could not open file %s\n", filename);
+        goto fail;
+    }
+
+    // 获取 stream 信息，写入到 fmt_ctx 中
+    ret = demux_find_stream_info(src->fmt_ctx, filename, probe_opts, want, timer);
+    if (ret < 0) {
+        printf("Could not find stream info %s\n", filename);
+        goto fail;
+    }
+
+    if (want & DEMUX_WANT_VIDEO) {
+        src->video_index = find_stream(src->fmt_ctx, AVMEDIA_TYPE_VIDEO);
+        if (src->video_index < 0) {
+            printf("Could not find video stream in %s\n", filename);
+            ret = AVERROR_STREAM_NOT_FOUND;
+            goto fail;
+        }
+    }
+    if (want & DEMUX_WANT_AUDIO) {
+        src->audio_index = find_stream(src->fmt_ctx, AVMEDIA_TYPE_AUDIO);
+        if (src->audio_index < 0) {
+            printf("Could not find audio stream in %s\n", filename);
+            ret = AVERROR_STREAM_NOT_FOUND;
+            goto fail;
+        }
+    }
+    // 其他音轨、字幕的 packet 解复用时就跳过
+    demux_keep_streams(src->fmt_ctx, src->video_index, src->audio_index);
+    return 0;
+
+fail:
+    media_source_close(src);
+    return ret;
+}
+
+void
+media_source_close(MediaSource *src) {
+    // 先关闭 AVFormatContext，它还在用自定义 io 的 AVIOContext
+    avformat_close_input(&src->fmt_ctx);
+    file_io_close(&src->io);
+    src->video_index = -1;
+    src->audio_index = -1;
+}
+
+int64_t
+media_source_bytes_read(const MediaSource *src) {
+    if (src->fmt_ctx == NULL || src->fmt_ctx->pb == NULL) {
+        return 0;
+    }
+    return src->fmt_ctx->pb->bytes_read;
+}
+
+double
+media_source_duration(const MediaSource *src) {
+    if (src->fmt_ctx == NULL || src->fmt_ctx->duration == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    return src->fmt_ctx->duration / (double)AV_TIME_BASE;
+}
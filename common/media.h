@@ -0,0 +1,38 @@
+#ifndef COMMON_MEDIA_H
+#define COMMON_MEDIA_H
+
+#include <libavformat/avformat.h>
+
+#include "demux.h"
+#include "file_io.h"
+
+// 打开的输入文件和选中的音视频流，代替每个程序里复制的打开文件、获取流信息、找流的套路代码
+// media_source_open 失败时已经释放了打开到一半的资源，成功后用 media_source_close 释放
+// media_source_close 可以重复调用，清零的结构体也可以直接 close，出错处理时不用区分打开到了哪一步
+typedef struct MediaSource {
+    AVFormatContext *fmt_ctx;
+    FileIO *io;
+    // 没有选中时是 -1
+    int video_index;
+    int audio_index;
+} MediaSource;
+
+// 打开文件并获取流信息，按 want 选出音视频流，没选中的流解复用时直接跳过
+// want 是 DEMUX_WANT_VIDEO / DEMUX_WANT_AUDIO 的组合，要的流找不到时返回 AVERROR_STREAM_NOT_FOUND
+// io_opts 为 NULL 时用 libavformat 自带的方式读文件，timer 可以为 NULL
+int
+media_source_open(MediaSource *src, const char *filename, const FileIOOptions *io_opts, const ProbeOptions *probe_opts,
+                  int want, StartupTimer *timer);
+
+void
+media_source_close(MediaSource *src);
+
+// 从文件读取的字节数
+int64_t
+media_source_bytes_read(const MediaSource *src);
+
+// 文件的时长，单位秒，不知道时为 0
+double
+media_source_duration(const MediaSource *src);
+
+#endif
@@ -0,0 +1,193 @@
+#include "pcm.h"
+
+#include <libavutil/cpu.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// AVX2 不是 x86-64 的基本指令集，用 target 属性单独编译这几个函数，运行时确认 cpu 支持才调用
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PCM_HAVE_AVX2 1
+#define PCM_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define S16_SCALE (1.0f / 32768)
+
+static void
+interleave_c(float *dst, const float *const *src, int channels, int start, int samples) {
+    for (int i = start; i < samples; i++) {
+        for (int c = 0; c < channels; c++) {
+            *dst++ = src[c][i];
+        }
+    }
+}
+
+static void
+s16_to_float_c(float *dst, const int16_t *src, int start, int count) {
+    for (int i = start; i < count; i++) {
+        dst[i] = src[i] * S16_SCALE;
+    }
+}
+
+static void
+gain_c(float *data, int start, int count, float gain) {
+    for (int i = start; i < count; i++) {
+        data[i] *= gain;
+    }
+}
+
+#if defined(__SSE2__)
+// 一次处理 4 个采样，返回处理到的位置，剩下的交给普通循环
+// 解码器和 av_samples_alloc 的缓冲区都是对齐的，但是不保证，统一用不要求对齐的读写
+static int
+interleave_stereo_sse2(float *dst, const float *l, const float *r, int samples) {
+    int i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 vl = _mm_loadu_ps(l + i);
+        __m128 vr = _mm_loadu_ps(r + i);
+        _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(vl, vr));
+        _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(vl, vr));
+    }
+    return i;
+}
+
+static int
+s16_to_float_sse2(float *dst, const int16_t *src, int count) {
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        // 放到 32 位的高 16 位再算术右移，完成符号扩展
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    return i;
+}
+
+static int
+gain_sse2(float *data, int count, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+    }
+    return i;
+}
+#endif
+
+#if defined(PCM_HAVE_AVX2)
+PCM_AVX2 static int
+interleave_stereo_avx2(float *dst, const float *l, const float *r, int samples) {
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256 vl = _mm256_loadu_ps(l + i);
+        __m256 vr = _mm256_loadu_ps(r + i);
+        // unpack 只在 128 位的两半里各自交错：lo = L0 R0 L1 R1 | L4 R4 L5 R5，hi = L2 R2 L3 R3 | L6 R6 L7 R7
+        __m256 lo = _mm256_unpacklo_ps(vl, vr);
+        __m256 hi = _mm256_unpackhi_ps(vl, vr);
+        _mm256_storeu_ps(dst + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(dst + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    return i;
+}
+
+PCM_AVX2 static int
+s16_to_float_avx2(float *dst, const int16_t *src, int count) {
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i + 8)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    return i;
+}
+
+PCM_AVX2 static int
+gain_avx2(float *data, int count, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), g));
+        _mm256_storeu_ps(data + i + 8, _mm256_mul_ps(_mm256_loadu_ps(data + i + 8), g));
+    }
+    return i;
+}
+#endif
+
+// av_get_cpu_flags 第一次调用后会缓存结果，每次调用都查一下也没有开销
+static int
+use_avx2(void) {
+#if defined(PCM_HAVE_AVX2)
+    return (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) != 0;
+#else
+    return 0;
+#endif
+}
+
+void
+pcm_interleave_float(float *dst, const float *const *src, int channels, int samples) {
+    if (channels == 1) {
+        memcpy(dst, src[0], samples * sizeof(float));
+        return;
+    }
+    int i = 0;
+    // 双声道最常见，其他声道数直接用普通循环
+    if (channels == 2) {
+#if defined(PCM_HAVE_AVX2)
+        if (use_avx2()) {
+            i = interleave_stereo_avx2(dst, src[0], src[1], samples);
+        }
+#endif
+#if defined(__SSE2__)
+        i += interleave_stereo_sse2(dst + 2 * i, src[0] + i, src[1] + i, samples - i);
+#endif
+    }
+    interleave_c(dst + channels * i, src, channels, i, samples);
+}
+
+void
+pcm_s16_to_float(float *dst, const int16_t *src, int count) {
+    int i = 0;
+#if defined(PCM_HAVE_AVX2)
+    if (use_avx2()) {
+        i = s16_to_float_avx2(dst, src, count);
+    }
+#endif
+#if defined(__SSE2__)
+    i += s16_to_float_sse2(dst + i, src + i, count - i);
+#endif
+    s16_to_float_c(dst, src, i, count);
+}
+
+void
+pcm_apply_gain(float *data, int count, float gain) {
+    int i = 0;
+#if defined(PCM_HAVE_AVX2)
+    if (use_avx2()) {
+        i = gain_avx2(data, count, gain);
+    }
+#endif
+#if defined(__SSE2__)
+    i += gain_sse2(data + i, count - i, gain);
+#endif
+    gain_c(data, i, count, gain);
+}
+
+const char *
+pcm_simd_name(void) {
+    if (use_avx2()) {
+        return "avx2";
+    }
+#if defined(__SSE2__)
+    return "sse2";
+#else
+    return "c";
+#endif
+}
@@ -0,0 +1,26 @@
+#ifndef COMMON_PCM_H
+#define COMMON_PCM_H
+
+#include <stdint.h>
+
+// 采样率和声道布局不变时的采样格式转换和音量处理
+// 只是交错、转 float 或者乘一个系数，用 SIMD 直接做，比走 swresample 的通用流程快得多
+// 运行时按 cpu 支持选择 AVX2 / SSE2 实现，其他平台用普通循环，结果和普通循环完全一样
+
+// 把 channels 个平面的 float 交错成 L R L R ...，每个平面 samples 个采样
+void
+pcm_interleave_float(float *dst, const float *const *src, int channels, int samples);
+
+// s16 转 float，除以 32768，范围 [-1, 1)，count 是采样总数（所有声道）
+void
+pcm_s16_to_float(float *dst, const int16_t *src, int count);
+
+// 每个采样乘以 gain，原地修改
+void
+pcm_apply_gain(float *data, int count, float gain);
+
+// 当前 cpu 上用的实现：avx2、sse2 或者 c
+const char *
+pcm_simd_name(void);
+
+#endif
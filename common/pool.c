@@ -0,0 +1,178 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int
+object_pool_init(ObjectPool *p, int capacity) {
+    p->items = calloc(capacity, sizeof(void *));
+    if (p->items == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    p->count = 0;
+    p->capacity = capacity;
+    p->preallocated = 0;
+    p->allocated = 0;
+    p->reused = 0;
+    pthread_mutex_init(&p->lock, NULL);
+    return 0;
+}
+
+// 初始化时先放进去的对象，不算在 allocated 里
+static void
+object_pool_prefill(ObjectPool *p, void *item) {
+    p->items[p->count] = item;
+    p->count += 1;
+    p->preallocated += 1;
+}
+
+// 池空了返回 NULL，由调用方新分配
+static void *
+object_pool_get(ObjectPool *p) {
+    void *item = NULL;
+    pthread_mutex_lock(&p->lock);
+    if (p->count > 0) {
+        p->count -= 1;
+        item = p->items[p->count];
+        p->reused += 1;
+    } else {
+        p->allocated += 1;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return item;
+}
+
+// 池满了返回 -1，由调用方释放
+static int
+object_pool_put(ObjectPool *p, void *item) {
+    int ret = -1;
+    pthread_mutex_lock(&p->lock);
+    if (p->count < p->capacity) {
+        p->items[p->count] = item;
+        p->count += 1;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return ret;
+}
+
+static void
+object_pool_print_stats(ObjectPool *p, const char *name) {
+    pthread_mutex_lock(&p->lock);
+    printf("pool %s: %d preallocated, %lld allocated, %lld reused, %d idle\n", name, p->preallocated,
+           (long long)p->allocated, (long long)p->reused, p->count);
+    pthread_mutex_unlock(&p->lock);
+}
+
+int
+packet_pool_init(PacketPool *p, int capacity) {
+    int ret = object_pool_init(&p->pool, capacity);
+    if (ret < 0) {
+        return ret;
+    }
+    for (int i = 0; i < capacity; i++) {
+        AVPacket *packet = av_packet_alloc();
+        if (packet == NULL) {
+            packet_pool_destroy(p);
+            return AVERROR(ENOMEM);
+        }
+        object_pool_prefill(&p->pool, packet);
+    }
+    return 0;
+}
+
+AVPacket *
+packet_pool_get(PacketPool *p) {
+    AVPacket *packet = object_pool_get(&p->pool);
+    return packet != NULL ? packet : av_packet_alloc();
+}
+
+void
+packet_pool_put(PacketPool *p, AVPacket **packet) {
+    if (*packet == NULL) {
+        return;
+    }
+    av_packet_unref(*packet);
+    if (object_pool_put(&p->pool, *packet) < 0) {
+        av_packet_free(packet);
+    }
+    *packet = NULL;
+}
+
+void
+packet_pool_destroy(PacketPool *p) {
+    for (int i = 0; i < p->pool.count; i++) {
+        AVPacket *packet = p->pool.items[i];
+        av_packet_free(&packet);
+    }
+    free(p->pool.items);
+    p->pool.items = NULL;
+    p->pool.count = 0;
+    pthread_mutex_destroy(&p->pool.lock);
+}
+
+void
+packet_pool_print_stats(PacketPool *p, const char *name) {
+    object_pool_print_stats(&p->pool, name);
+}
+
+int
+frame_pool_init(FramePool *p, int capacity) {
+    int ret = object_pool_init(&p->pool, capacity);
+    if (ret < 0) {
+        return ret;
+    }
+    for (int i = 0; i < capacity; i++) {
+        AVFrame *frame = av_frame_alloc();
+        if (frame == NULL) {
+            frame_pool_destroy(p);
+            return AVERROR(ENOMEM);
+        }
+        object_pool_prefill(&p->pool, frame);
+    }
+    return 0;
+}
+
+AVFrame *
+frame_pool_get(FramePool *p) {
+    AVFrame *frame = object_pool_get(&p->pool);
+    return frame != NULL ? frame : av_frame_alloc();
+}
+
+AVFrame *
+frame_pool_move(FramePool *p, AVFrame *src) {
+    AVFrame *frame = frame_pool_get(p);
+    if (frame != NULL) {
+        av_frame_move_ref(frame, src);
+    }
+    return frame;
+}
+
+void
+frame_pool_put(FramePool *p, AVFrame **frame) {
+    if (*frame == NULL) {
+        return;
+    }
+    av_frame_unref(*frame);
+    if (object_pool_put(&p->pool, *frame) < 0) {
+        av_frame_free(frame);
+    }
+    *frame = NULL;
+}
+
+void
+frame_pool_destroy(FramePool *p) {
+    for (int i = 0; i < p->pool.count; i++) {
+        AVFrame *frame = p->pool.items[i];
+        av_frame_free(&frame);
+    }
+    free(p->pool.items);
+    p->pool.items = NULL;
+    p->pool.count = 0;
+    pthread_mutex_destroy(&p->pool.lock);
+}
+
+void
+frame_pool_print_stats(FramePool *p, const char *name) {
+    object_pool_print_stats(&p->pool, name);
+}
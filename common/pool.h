@@ -0,0 +1,70 @@
+#ifndef COMMON_POOL_H
+#define COMMON_POOL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// 线程安全的 AVPacket / AVFrame 对象池
+// 初始化时就分配好 capacity 个对象，用完的对象 unref 以后放回池里，下次 get 直接拿出来用
+// capacity 按队列长度设置时播放过程中不再 alloc 和 free，allocated 一直是 0
+// 池空了才临时新分配，池里最多保留 capacity 个空闲对象，多出来的直接释放
+typedef struct ObjectPool {
+    pthread_mutex_t lock;
+    void **items;
+    int count;
+    int capacity;
+    // 初始化时分配的个数，池空了临时新分配的个数和从池里复用的个数
+    int preallocated;
+    int64_t allocated;
+    int64_t reused;
+} ObjectPool;
+
+typedef struct PacketPool {
+    ObjectPool pool;
+} PacketPool;
+
+typedef struct FramePool {
+    ObjectPool pool;
+} FramePool;
+
+int
+packet_pool_init(PacketPool *p, int capacity);
+
+// 取一个空的 packet，池空了就新分配，失败返回 NULL
+AVPacket *
+packet_pool_get(PacketPool *p);
+
+// 释放 packet 里的数据，把 packet 放回池里，*packet 被设为 NULL
+void
+packet_pool_put(PacketPool *p, AVPacket **packet);
+
+// 释放池里的空闲 packet，还没放回来的 packet 要用 av_packet_free 释放
+void
+packet_pool_destroy(PacketPool *p);
+
+void
+packet_pool_print_stats(PacketPool *p, const char *name);
+
+int
+frame_pool_init(FramePool *p, int capacity);
+
+AVFrame *
+frame_pool_get(FramePool *p);
+
+// 取一个 frame，用 av_frame_move_ref 把 src 的数据转移进去，src 变成空的 frame 可以接着用来解码
+// 只转移引用，不拷贝图像，失败返回 NULL，src 不变
+AVFrame *
+frame_pool_move(FramePool *p, AVFrame *src);
+
+void
+frame_pool_put(FramePool *p, AVFrame **frame);
+
+void
+frame_pool_destroy(FramePool *p);
+
+void
+frame_pool_print_stats(FramePool *p, const char *name);
+
+#endif
@@ -0,0 +1,226 @@
+#include "queue.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+// 等待对端时先让出 cpu 的次数，对端通常很快就能腾出位置或者放入数据，不用进内核睡眠
+#define QUEUE_SPINS 64
+
+// 放入或取出之后调用，有线程睡在条件变量上才加锁唤醒
+// 和 queue_sleep 里先加 waiters 再检查队列配对，两边都是 seq_cst，对端要么看到新数据，要么这里看到 waiters
+static void
+queue_wake(Queue *q) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->waiters, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+int
+queue_init(Queue *q, unsigned int capacity, int64_t max_bytes) {
+    q->items = calloc(capacity, sizeof(void *));
+    q->sizes = calloc(capacity, sizeof(int64_t));
+    if (q->items == NULL || q->sizes == NULL) {
+        free(q->items);
+        free(q->sizes);
+        return -1;
+    }
+    q->capacity = capacity;
+    q->max_bytes = max_bytes;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->bytes, 0);
+    atomic_init(&q->finished, 0);
+    atomic_init(&q->aborted, 0);
+    atomic_init(&q->waiters, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    // 超时等待用 CLOCK_MONOTONIC，不受系统时间调整影响
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return 0;
+}
+
+void
+queue_destroy(Queue *q) {
+    free(q->items);
+    free(q->sizes);
+    q->items = NULL;
+    q->sizes = NULL;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+int
+queue_try_push(Queue *q, void *item, int64_t size) {
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+    unsigned int count = tail - head;
+    if (count >= q->capacity) {
+        return -1;
+    }
+    // 空队列总是允许放入，否则单个超大元素会让两端永远等下去
+    int64_t bytes = atomic_load_explicit(&q->bytes, memory_order_relaxed);
+    if (q->max_bytes > 0 && count > 0 && bytes + size > q->max_bytes) {
+        return -1;
+    }
+
+    q->items[tail % q->capacity] = item;
+    q->sizes[tail % q->capacity] = size;
+    atomic_fetch_add_explicit(&q->bytes, size, memory_order_relaxed);
+    // release 保证消费者看到新的 tail 时，元素已经写好
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    queue_wake(q);
+    return 0;
+}
+
+void *
+queue_try_pop(Queue *q) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+
+    void *item = q->items[head % q->capacity];
+    atomic_fetch_sub_explicit(&q->bytes, q->sizes[head % q->capacity], memory_order_relaxed);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    queue_wake(q);
+    return item;
+}
+
+void *
+queue_peek(Queue *q) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    return q->items[head % q->capacity];
+}
+
+// 消费者等待的条件：有数据、生产者结束或者队列被取消
+static int
+queue_readable(Queue *q) {
+    return atomic_load(&q->aborted) || atomic_load(&q->finished) || queue_count(q) > 0;
+}
+
+// 生产者等待的条件：放得下 size 字节的元素或者队列被取消，和 queue_try_push 的判断一致
+static int
+queue_writable(Queue *q, int64_t size) {
+    if (atomic_load(&q->aborted)) {
+        return 1;
+    }
+    unsigned int count = queue_count(q);
+    if (count == 0) {
+        return 1;
+    }
+    return count < q->capacity && (q->max_bytes <= 0 || atomic_load(&q->bytes) + size <= q->max_bytes);
+}
+
+// 先让出几次 cpu，还不行就睡到对端唤醒，size < 0 表示消费者等数据，否则是生产者等空间
+static void
+queue_sleep(Queue *q, int *spins, int64_t size) {
+    if (*spins < QUEUE_SPINS) {
+        *spins += 1;
+        sched_yield();
+        return;
+    }
+    pthread_mutex_lock(&q->lock);
+    atomic_fetch_add(&q->waiters, 1);
+    // 加了 waiters 以后再检查一次，对端在这之前的修改这里能看到，之后的修改会来唤醒
+    int ready = size < 0 ? queue_readable(q) : queue_writable(q, size);
+    if (!ready) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    pthread_mutex_unlock(&q->lock);
+}
+
+int
+queue_push(Queue *q, void *item, int64_t size) {
+    int spins = 0;
+    while (queue_try_push(q, item, size) < 0) {
+        if (atomic_load(&q->aborted)) {
+            return -1;
+        }
+        queue_sleep(q, &spins, size);
+    }
+    return 0;
+}
+
+void *
+queue_pop(Queue *q) {
+    int spins = 0;
+    while (1) {
+        if (atomic_load(&q->aborted)) {
+            return NULL;
+        }
+        // 先读 finished 再取数据，避免漏掉生产者结束前放入的最后几个元素
+        int finished = atomic_load(&q->finished);
+        void *item = queue_try_pop(q);
+        if (item != NULL) {
+            return item;
+        }
+        if (finished) {
+            return NULL;
+        }
+        queue_sleep(q, &spins, -1);
+    }
+}
+
+void
+queue_wait(Queue *q, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&q->lock);
+    atomic_fetch_add(&q->waiters, 1);
+    // 生产者结束以后没有数据也等到超时，调用方在两次等待之间还要处理别的事情，不能空转
+    if (!atomic_load(&q->aborted) && queue_count(q) == 0) {
+        pthread_cond_timedwait(&q->cond, &q->lock, &deadline);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// 修改状态后无条件唤醒，结束和取消只发生一次，不在意加锁的开销
+static void
+queue_wake_all(Queue *q) {
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void
+queue_finish(Queue *q) {
+    atomic_store(&q->finished, 1);
+    queue_wake_all(q);
+}
+
+void
+queue_abort(Queue *q) {
+    atomic_store(&q->aborted, 1);
+    queue_wake_all(q);
+}
+
+unsigned int
+queue_count(Queue *q) {
+    return atomic_load(&q->tail) - atomic_load(&q->head);
+}
+
+int
+queue_drained(Queue *q) {
+    return atomic_load(&q->finished) && queue_count(q) == 0;
+}
@@ -0,0 +1,79 @@
+#ifndef COMMON_QUEUE_H
+#define COMMON_QUEUE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// 单生产者单消费者（SPSC）的无锁队列，用来在线程之间传递 AVPacket* / AVFrame*
+// 同时限制元素个数和数据总字节数，满了生产者等待，空了消费者等待，实现背压
+// 放入和取出不加锁；等待的一方先让出几次 cpu，还不行就睡在条件变量上，由对端放入或取出后唤醒
+typedef struct Queue {
+    void **items;
+    int64_t *sizes;
+    // 最多能放多少个元素
+    unsigned int capacity;
+    // 队列里数据的总字节数上限，0 表示不限制
+    int64_t max_bytes;
+    // head 只由消费者修改，tail 只由生产者修改，都是单调递增的计数
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_llong bytes;
+    // 生产者不会再放入数据
+    atomic_int finished;
+    // 队列被取消，两端都不再等待
+    atomic_int aborted;
+    // 睡眠等待用，waiters 是睡在 cond 上的线程数，为 0 时放入和取出不碰锁
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int waiters;
+} Queue;
+
+int
+queue_init(Queue *q, unsigned int capacity, int64_t max_bytes);
+
+void
+queue_destroy(Queue *q);
+
+// 非阻塞版本，队列满了返回 -1
+int
+queue_try_push(Queue *q, void *item, int64_t size);
+
+// 非阻塞版本，队列空了返回 NULL
+void *
+queue_try_pop(Queue *q);
+
+// 查看队头元素但不取出，只能由消费者调用
+void *
+queue_peek(Queue *q);
+
+// 阻塞版本，队列满了等待，队列被取消时返回 -1
+int
+queue_push(Queue *q, void *item, int64_t size);
+
+// 阻塞版本，队列空了等待，生产者已经结束或队列被取消时返回 NULL
+void *
+queue_pop(Queue *q);
+
+// 消费者调用，等到队列里有数据、队列被取消或者超时（毫秒），不取出数据
+// 生产者结束以后也会等到超时，给需要在等待之间处理事件的线程用
+void
+queue_wait(Queue *q, int timeout_ms);
+
+// 生产者调用，表示不会再有新数据
+void
+queue_finish(Queue *q);
+
+// 取消队列，唤醒两端的等待
+void
+queue_abort(Queue *q);
+
+// 当前元素个数
+unsigned int
+queue_count(Queue *q);
+
+// 队列已经结束并且被取空了
+int
+queue_drained(Queue *q);
+
+#endif
@@ -0,0 +1,121 @@
+#include "scene_detect.h"
+
+#include <libavutil/pixdesc.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 亮度是第一个平面里连续存放的 8 位数据时可以直接读，yuv420p、nv12 这些常见格式都是
+static int
+has_luma_plane(enum AVPixelFormat format) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (desc == NULL || desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL |
+                                       AV_PIX_FMT_FLAG_BITSTREAM)) {
+        return 0;
+    }
+    return desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].offset == 0 &&
+           desc->comp[0].shift == 0 && desc->comp[0].depth == 8;
+}
+
+// 按块求平均把亮度平面缩小成签名，每个块隔一行取一行，只读一半数据
+static void
+downsample_luma(const uint8_t *data, int linesize, int width, int height, uint8_t *sig) {
+    int x0[SCENE_SIG_WIDTH + 1];
+    for (int x = 0; x <= SCENE_SIG_WIDTH; x++) {
+        x0[x] = x * width / SCENE_SIG_WIDTH;
+    }
+    for (int y = 0; y < SCENE_SIG_HEIGHT; y++) {
+        int y0 = y * height / SCENE_SIG_HEIGHT;
+        int y1 = (y + 1) * height / SCENE_SIG_HEIGHT;
+        uint32_t sums[SCENE_SIG_WIDTH] = {0};
+        int rows = 0;
+        for (int row = y0; row < y1; row += 2) {
+            const uint8_t *line = data + (ptrdiff_t)row * linesize;
+            for (int x = 0; x < SCENE_SIG_WIDTH; x++) {
+                uint32_t sum = 0;
+                for (int i = x0[x]; i < x0[x + 1]; i++) {
+                    sum += line[i];
+                }
+                sums[x] += sum;
+            }
+            rows += 1;
+        }
+        for (int x = 0; x < SCENE_SIG_WIDTH; x++) {
+            int count = rows * (x0[x + 1] - x0[x]);
+            sig[y * SCENE_SIG_WIDTH + x] = count > 0 ? sums[x] / count : 0;
+        }
+    }
+}
+
+// 两个签名逐字节差的绝对值之和
+static uint32_t
+sig_sad(const uint8_t *a, const uint8_t *b) {
+#if defined(__SSE2__)
+    // psadbw 一次算 16 个字节的差的绝对值之和，结果放在两个 64 位通道里
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < SCENE_SIG_SIZE; i += 16) {
+        __m128i va = _mm_load_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_load_si128((const __m128i *)(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#else
+    uint32_t sad = 0;
+    for (int i = 0; i < SCENE_SIG_SIZE; i++) {
+        sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+    return sad;
+#endif
+}
+
+void
+scene_detector_init(SceneDetector *d) {
+    memset(d, 0, sizeof(*d));
+}
+
+int
+scene_detector_frame(SceneDetector *d, const AVFrame *frame, double *score, double *luma) {
+    uint8_t *sig = d->sig[d->cur];
+    if (has_luma_plane(frame->format)) {
+        // 直接读解码出的亮度平面，不需要先转换成 rgb
+        downsample_luma(frame->data[0], frame->linesize[0], frame->width, frame->height, sig);
+    } else {
+        struct SwsContext *sws_ctx = scale_cache_get_frame(&d->scale_cache, frame, SCENE_SIG_WIDTH, SCENE_SIG_HEIGHT,
+                                                           AV_PIX_FMT_GRAY8, SWS_AREA);
+        if (sws_ctx == NULL) {
+            return -1;
+        }
+        uint8_t *dst[4] = {sig};
+        int dst_linesize[4] = {SCENE_SIG_WIDTH};
+        sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
+    }
+
+    uint32_t total = 0;
+    for (int i = 0; i < SCENE_SIG_SIZE; i++) {
+        total += sig[i];
+    }
+    *luma = (double)total / SCENE_SIG_SIZE;
+
+    if (!d->has_prev) {
+        *score = 1;
+        d->has_prev = 1;
+    } else {
+        // 平均差异占亮度范围的百分比，算法和 ffmpeg 的 scene 分数一样
+        // 镜头切换时这一对帧的差异突然变大，和上一对帧的差异也差得很多
+        // 淡入淡出和持续运动每一对帧差不多，取两者的较小值就不会误判
+        double mafd = sig_sad(sig, d->sig[!d->cur]) * 100.0 / SCENE_SIG_SIZE / 255;
+        double diff = fabs(mafd - d->prev_mafd);
+        *score = av_clipd(FFMIN(mafd, diff) / 100, 0, 1);
+        d->prev_mafd = mafd;
+    }
+    d->cur = !d->cur;
+    return 0;
+}
+
+void
+scene_detector_free(SceneDetector *d) {
+    scale_cache_free(&d->scale_cache);
+}
@@ -0,0 +1,39 @@
+#ifndef COMMON_SCENE_DETECT_H
+#define COMMON_SCENE_DETECT_H
+
+#include <libavutil/frame.h>
+#include <stdint.h>
+
+#include "convert.h"
+
+// 每一帧的签名是把亮度平面缩小成 64x36 的灰度图，比较相邻两帧签名的平均差异来判断镜头切换
+#define SCENE_SIG_WIDTH 64
+#define SCENE_SIG_HEIGHT 36
+#define SCENE_SIG_SIZE (SCENE_SIG_WIDTH * SCENE_SIG_HEIGHT)
+// 签名的平均亮度低于这个值认为是黑屏，不适合做缩略图
+#define SCENE_BLACK_LUMA 32
+
+typedef struct SceneDetector {
+    // 当前帧和上一帧的签名，轮流使用
+    _Alignas(16) uint8_t sig[2][SCENE_SIG_SIZE];
+    int cur;
+    int has_prev;
+    // 上一对帧的平均差异，用来排除持续运动和淡入淡出这种每帧都在变的情况
+    double prev_mafd;
+    // 不是 8 位亮度平面的格式先缩放成灰度图
+    ScaleCache scale_cache;
+} SceneDetector;
+
+void
+scene_detector_init(SceneDetector *d);
+
+// 计算 frame 的签名并和上一帧比较
+// score 是 0~1 的镜头切换分数，和 ffmpeg select 滤镜的 scene 含义相同，第一帧是 1
+// luma 是签名的平均亮度，0~255
+int
+scene_detector_frame(SceneDetector *d, const AVFrame *frame, double *score, double *luma);
+
+void
+scene_detector_free(SceneDetector *d);
+
+#endif
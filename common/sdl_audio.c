@@ -0,0 +1,47 @@
+#include "sdl_audio.h"
+
+#include <libavutil/channel_layout.h>
+
+enum AVSampleFormat
+sdl_audio_sample_fmt(SDL_AudioFormat format) {
+    // 只认本机字节序的格式，U8 的静音是 0x80，缓冲区补 0 会变成爆音，也不要
+    switch (format) {
+    case AUDIO_F32SYS:
+        return AV_SAMPLE_FMT_FLT;
+    case AUDIO_S32SYS:
+        return AV_SAMPLE_FMT_S32;
+    case AUDIO_S16SYS:
+        return AV_SAMPLE_FMT_S16;
+    default:
+        return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+uint64_t
+sdl_audio_channel_layout(int channels) {
+    switch (channels) {
+    case 3:
+        // FL FR LFE
+        return AV_CH_LAYOUT_2POINT1;
+    case 4:
+        // FL FR BL BR
+        return AV_CH_LAYOUT_QUAD;
+    case 5:
+        // FL FR LFE BL BR
+        return AV_CH_LAYOUT_QUAD | AV_CH_LOW_FREQUENCY;
+    default:
+        // 1、2、6、7、8 声道和 ffmpeg 的默认布局一样
+        return av_get_default_channel_layout(channels);
+    }
+}
+
+SDL_AudioDeviceID
+sdl_audio_open(const SDL_AudioSpec *desired, SDL_AudioSpec *obtained) {
+    SDL_AudioDeviceID device = SDL_OpenAudioDevice(NULL, 0, desired, obtained, SDL_AUDIO_ALLOW_ANY_CHANGE);
+    if (device != 0 && sdl_audio_sample_fmt(obtained->format) == AV_SAMPLE_FMT_NONE) {
+        SDL_CloseAudioDevice(device);
+        device = SDL_OpenAudioDevice(NULL, 0, desired, obtained,
+                                     SDL_AUDIO_ALLOW_ANY_CHANGE & ~SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    }
+    return device;
+}
@@ -0,0 +1,24 @@
+#ifndef COMMON_SDL_AUDIO_H
+#define COMMON_SDL_AUDIO_H
+
+#include <SDL2/SDL.h>
+#include <libavutil/samplefmt.h>
+#include <stdint.h>
+
+// SDL 音频格式对应的 ffmpeg 采样格式，swresample 输出不了或者静音不是 0 的格式返回 AV_SAMPLE_FMT_NONE
+enum AVSampleFormat
+sdl_audio_sample_fmt(SDL_AudioFormat format);
+
+// SDL 的声道顺序对应的 ffmpeg 声道布局
+// 3、4、5 声道时 SDL 的顺序和 av_get_default_channel_layout 不一样
+uint64_t
+sdl_audio_channel_layout(int channels);
+
+// 打开默认音频设备，采样率、声道数、格式和每次回调的采样数都按设备实际支持的来，写到 obtained 里
+// 调用方按 obtained 重采样，SDL 不用在后面再转换一次
+// 设备的格式 swresample 输出不了时重新打开，只有格式让 SDL 转换
+// 打开后设备是暂停的，准备好回调要读的数据以后用 SDL_PauseAudioDevice(device, 0) 开始播放，失败返回 0
+SDL_AudioDeviceID
+sdl_audio_open(const SDL_AudioSpec *desired, SDL_AudioSpec *obtained);
+
+#endif
@@ -0,0 +1,48 @@
+#include "sdl_video.h"
+
+Uint32
+sdl_texture_format(enum AVPixelFormat pix_fmt) {
+    switch (pix_fmt) {
+    case AV_PIX_FMT_YUV420P:
+        return SDL_PIXELFORMAT_IYUV;
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+    // SDL_UpdateNVTexture 从 2.0.16 开始才有
+    case AV_PIX_FMT_NV12:
+        return SDL_PIXELFORMAT_NV12;
+    case AV_PIX_FMT_NV21:
+        return SDL_PIXELFORMAT_NV21;
+#endif
+    default:
+        return 0;
+    }
+}
+
+enum AVPixelFormat
+sdl_upload_pix_fmt(enum AVPixelFormat pix_fmt) {
+    if (sdl_texture_format(pix_fmt) != 0) {
+        return pix_fmt;
+    }
+    return AV_PIX_FMT_YUV420P;
+}
+
+int
+sdl_upload_frame(SDL_Texture *texture, const AVFrame *frame) {
+    SDL_Rect rect;
+    rect.x = 0;
+    rect.y = 0;
+    rect.w = frame->width;
+    rect.h = frame->height;
+    switch (frame->format) {
+    case AV_PIX_FMT_YUV420P:
+        return SDL_UpdateYUVTexture(texture, &rect, frame->data[0], frame->linesize[0], frame->data[1],
+                                    frame->linesize[1], frame->data[2], frame->linesize[2]);
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+        return SDL_UpdateNVTexture(texture, &rect, frame->data[0], frame->linesize[0], frame->data[1],
+                                   frame->linesize[1]);
+#endif
+    default:
+        return -1;
+    }
+}
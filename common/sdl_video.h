@@ -0,0 +1,21 @@
+#ifndef COMMON_SDL_VIDEO_H
+#define COMMON_SDL_VIDEO_H
+
+#include <SDL2/SDL.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+// 解码出的像素格式能直接上传到 SDL 纹理时返回对应的 SDL 像素格式，否则返回 0
+Uint32
+sdl_texture_format(enum AVPixelFormat pix_fmt);
+
+// 纹理使用的像素格式：能直接上传就用解码器输出的格式，省掉一次转换和拷贝，否则转换成 yuv420p
+enum AVPixelFormat
+sdl_upload_pix_fmt(enum AVPixelFormat pix_fmt);
+
+// 直接用 frame->data / frame->linesize 更新纹理
+// frame 的格式必须是 sdl_upload_pix_fmt 返回的格式
+int
+sdl_upload_frame(SDL_Texture *texture, const AVFrame *frame);
+
+#endif
@@ -0,0 +1,261 @@
+#include "seek_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 每个流的 packet 先收集在这里，扫描完再写文件
+typedef struct EntryList {
+    SeekIndexEntry *entries;
+    int64_t count;
+    int64_t capacity;
+} EntryList;
+
+static int
+entry_list_add(EntryList *list, const SeekIndexEntry *entry) {
+    if (list->count == list->capacity) {
+        int64_t capacity = list->capacity > 0 ? list->capacity * 2 : 1024;
+        SeekIndexEntry *entries = realloc(list->entries, capacity * sizeof(SeekIndexEntry));
+        if (entries == NULL) {
+            return -1;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+    list->entries[list->count] = *entry;
+    list->count += 1;
+    return 0;
+}
+
+static int
+compare_pts(const void *a, const void *b) {
+    int64_t x = ((const SeekIndexEntry *)a)->pts;
+    int64_t y = ((const SeekIndexEntry *)b)->pts;
+    return (x > y) - (x < y);
+}
+
+static char *
+index_path(const char *filename) {
+    size_t len = strlen(filename);
+    char *path = malloc(len + sizeof(".idx"));
+    if (path != NULL) {
+        memcpy(path, filename, len);
+        memcpy(path + len, ".idx", sizeof(".idx"));
+    }
+    return path;
+}
+
+static int
+file_info(const char *filename, int64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(filename, &st) < 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int
+write_index(const char *filename, AVFormatContext *fmt_ctx, EntryList *packets, EntryList *keys) {
+    SeekIndexHeader header = {.magic = SEEK_INDEX_MAGIC, .nb_streams = fmt_ctx->nb_streams};
+    if (file_info(filename, &header.file_size, &header.file_mtime) < 0) {
+        return -1;
+    }
+    char *path = index_path(filename);
+    FILE *f = path != NULL ? fopen(path, "wb") : NULL;
+    free(path);
+    if (f == NULL) {
+        return -1;
+    }
+
+    // 文件头和流表之后依次是每个流的 packet 和关键帧
+    int64_t offset = sizeof(header) + header.nb_streams * sizeof(SeekIndexStream);
+    fwrite(&header, sizeof(header), 1, f);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        SeekIndexStream s = {
+            .time_base_num = fmt_ctx->streams[i]->time_base.num,
+            .time_base_den = fmt_ctx->streams[i]->time_base.den,
+            .packets_offset = offset,
+            .packet_count = packets[i].count,
+            .keys_offset = offset + packets[i].count * sizeof(SeekIndexEntry),
+            .key_count = keys[i].count,
+        };
+        offset = s.keys_offset + keys[i].count * sizeof(SeekIndexEntry);
+        fwrite(&s, sizeof(s), 1, f);
+    }
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        fwrite(packets[i].entries, sizeof(SeekIndexEntry), packets[i].count, f);
+        fwrite(keys[i].entries, sizeof(SeekIndexEntry), keys[i].count, f);
+    }
+    int error = ferror(f);
+    return fclose(f) == 0 && !error ? 0 : -1;
+}
+
+int
+seek_index_build(AVFormatContext *fmt_ctx, const char *filename) {
+    unsigned int nb_streams = fmt_ctx->nb_streams;
+    EntryList *packets = calloc(nb_streams, sizeof(EntryList));
+    EntryList *keys = calloc(nb_streams, sizeof(EntryList));
+    AVPacket *packet = av_packet_alloc();
+    int ret = -1;
+    if (packets == NULL || keys == NULL || packet == NULL) {
+        goto end;
+    }
+
+    // 只读 packet，不解码
+    while (av_read_frame(fmt_ctx, packet) == 0) {
+        unsigned int i = packet->stream_index;
+        if (i < nb_streams) {
+            SeekIndexEntry entry = {
+                .pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts,
+                .dts = packet->dts,
+                .pos = packet->pos,
+                .flags = packet->flags,
+            };
+            if (entry_list_add(&packets[i], &entry) < 0 ||
+                ((entry.flags & AV_PKT_FLAG_KEY) && entry.pts != AV_NOPTS_VALUE && entry_list_add(&keys[i], &entry) < 0)) {
+                av_packet_unref(packet);
+                goto end;
+            }
+        }
+        av_packet_unref(packet);
+    }
+
+    for (unsigned int i = 0; i < nb_streams; i++) {
+        qsort(keys[i].entries, keys[i].count, sizeof(SeekIndexEntry), compare_pts);
+    }
+    ret = write_index(filename, fmt_ctx, packets, keys);
+
+end:
+    for (unsigned int i = 0; packets != NULL && i < nb_streams; i++) {
+        free(packets[i].entries);
+    }
+    for (unsigned int i = 0; keys != NULL && i < nb_streams; i++) {
+        free(keys[i].entries);
+    }
+    free(packets);
+    free(keys);
+    av_packet_free(&packet);
+    return ret;
+}
+
+SeekIndex *
+seek_index_open(const char *filename) {
+    int64_t file_size, file_mtime;
+    if (file_info(filename, &file_size, &file_mtime) < 0) {
+        return NULL;
+    }
+    char *path = index_path(filename);
+    int fd = path != NULL ? open(path, O_RDONLY) : -1;
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SeekIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    SeekIndex *index = calloc(1, sizeof(SeekIndex));
+    if (index == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    index->map = map;
+    index->size = st.st_size;
+    index->header = (const SeekIndexHeader *)map;
+    index->streams = (const SeekIndexStream *)(map + sizeof(SeekIndexHeader));
+
+    // 检查索引是不是这个文件的，以及每一段都在文件范围内
+    const SeekIndexHeader *h = index->header;
+    int valid = h->magic == SEEK_INDEX_MAGIC && h->file_size == file_size && h->file_mtime == file_mtime &&
+                h->nb_streams >= 0 && h->nb_streams <= 65536 &&
+                sizeof(SeekIndexHeader) + h->nb_streams * sizeof(SeekIndexStream) <= index->size;
+    for (int64_t i = 0; valid && i < h->nb_streams; i++) {
+        const SeekIndexStream *s = &index->streams[i];
+        valid = s->packet_count >= 0 && s->key_count >= 0 && s->packets_offset >= 0 && s->keys_offset >= 0 &&
+                s->packets_offset + s->packet_count * (int64_t)sizeof(SeekIndexEntry) <= (int64_t)index->size &&
+                s->keys_offset + s->key_count * (int64_t)sizeof(SeekIndexEntry) <= (int64_t)index->size;
+    }
+    if (!valid) {
+        seek_index_close(&index);
+        return NULL;
+    }
+    return index;
+}
+
+void
+seek_index_close(SeekIndex **index) {
+    SeekIndex *i = *index;
+    if (i == NULL) {
+        return;
+    }
+    munmap(i->map, i->size);
+    free(i);
+    *index = NULL;
+}
+
+const SeekIndexEntry *
+seek_index_keys(const SeekIndex *index, int stream_index, int64_t *count) {
+    if (stream_index < 0 || stream_index >= index->header->nb_streams) {
+        *count = 0;
+        return NULL;
+    }
+    const SeekIndexStream *s = &index->streams[stream_index];
+    *count = s->key_count;
+    return (const SeekIndexEntry *)(index->map + s->keys_offset);
+}
+
+const SeekIndexEntry *
+seek_index_find_key(const SeekIndex *index, int stream_index, int64_t target) {
+    int64_t count;
+    const SeekIndexEntry *keys = seek_index_keys(index, stream_index, &count);
+    if (count == 0) {
+        return NULL;
+    }
+    // 找第一个 pts > target 的位置，前一个就是要找的关键帧
+    int64_t lo = 0;
+    int64_t hi = count;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (keys[mid].pts <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? &keys[lo - 1] : &keys[0];
+}
+
+int
+seek_index_seek(const SeekIndex *index, AVFormatContext *fmt_ctx, int stream_index, int64_t target, int64_t *key_pts) {
+    const SeekIndexEntry *key = seek_index_find_key(index, stream_index, target);
+    if (key == NULL) {
+        return AVERROR(ENOENT);
+    }
+    *key_pts = key->pts;
+
+    // mpegts / mpegps 没有容器索引，按时间 seek 要在文件里来回二分读取，按字节位置直接跳过去
+    int ret = -1;
+    if (key->pos >= 0 && (fmt_ctx->iformat->flags & AVFMT_TS_DISCONT) &&
+        !(fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+        ret = av_seek_frame(fmt_ctx, stream_index, key->pos, AVSEEK_FLAG_BYTE);
+    }
+    if (ret < 0) {
+        // 已经知道关键帧的准确时间，解复用器正好落在这个关键帧上
+        ret = avformat_seek_file(fmt_ctx, stream_index, INT64_MIN, key->pts, key->pts, 0);
+    }
+    return ret;
+}
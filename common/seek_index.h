@@ -0,0 +1,70 @@
+#ifndef COMMON_SEEK_INDEX_H
+#define COMMON_SEEK_INDEX_H
+
+#include <libavformat/avformat.h>
+#include <stdint.h>
+
+// 关键帧索引文件 <文件名>.idx，由 tools/seek_index.c 扫描一遍文件生成
+// 记录每个流每个 packet 的 pts / dts / 文件位置 / 是否关键帧
+// 加载时直接 mmap，找关键帧是二分查找，不用让解复用器重新去找
+#define SEEK_INDEX_MAGIC 0x31495350 // "PSI1"
+
+// 每个 packet 一条，全部用 int64_t，没有填充，可以直接读写
+typedef struct SeekIndexEntry {
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;
+    int64_t flags;
+} SeekIndexEntry;
+
+typedef struct SeekIndexStream {
+    int64_t time_base_num;
+    int64_t time_base_den;
+    // 全部 packet，按读到的顺序（解码顺序）
+    int64_t packets_offset;
+    int64_t packet_count;
+    // 只有关键帧，按 pts 排序，用来二分查找
+    int64_t keys_offset;
+    int64_t key_count;
+} SeekIndexStream;
+
+typedef struct SeekIndexHeader {
+    int64_t magic;
+    // 媒体文件的大小和修改时间，任何一个变了索引就作废
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t nb_streams;
+} SeekIndexHeader;
+
+typedef struct SeekIndex {
+    uint8_t *map;
+    size_t size;
+    const SeekIndexHeader *header;
+    const SeekIndexStream *streams;
+} SeekIndex;
+
+// 扫描整个文件生成索引，写到 <filename>.idx，成功返回 0
+int
+seek_index_build(AVFormatContext *fmt_ctx, const char *filename);
+
+// 加载 <filename>.idx，不存在或者和媒体文件对不上返回 NULL
+SeekIndex *
+seek_index_open(const char *filename);
+
+void
+seek_index_close(SeekIndex **index);
+
+// 流的全部关键帧，按 pts 排序，count 返回个数
+const SeekIndexEntry *
+seek_index_keys(const SeekIndex *index, int stream_index, int64_t *count);
+
+// 找 pts <= target 的最后一个关键帧，target 在第一个关键帧之前时返回第一个，没有关键帧返回 NULL
+const SeekIndexEntry *
+seek_index_find_key(const SeekIndex *index, int stream_index, int64_t target);
+
+// 跳到 target 之前（含）最近的关键帧，key_pts 返回这个关键帧的 pts
+// mpegts 这类没有容器索引的格式按字节位置跳，其他格式按关键帧的准确时间跳
+int
+seek_index_seek(const SeekIndex *index, AVFormatContext *fmt_ctx, int stream_index, int64_t target, int64_t *key_pts);
+
+#endif
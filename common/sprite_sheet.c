@@ -0,0 +1,225 @@
+#include "sprite_sheet.h"
+
+#include <libavutil/pixdesc.h>
+#include <string.h>
+
+static AVFrame *
+alloc_canvas(SpriteSheet *s) {
+    AVFrame *canvas = av_frame_alloc();
+    if (canvas == NULL) {
+        return NULL;
+    }
+    canvas->format = export_format_pix_fmt(s->format);
+    canvas->width = s->cols * s->tile_width;
+    canvas->height = s->rows * s->tile_height;
+    if (av_frame_get_buffer(canvas, 32) < 0) {
+        av_frame_free(&canvas);
+        return NULL;
+    }
+    // 没放满的格子是黑色，yuv 的色度平面 128 表示没有颜色
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(canvas->format);
+    for (int i = 0; i < 4 && canvas->data[i] != NULL; i++) {
+        int chroma = i > 0 && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int height = chroma ? AV_CEIL_RSHIFT(canvas->height, desc->log2_chroma_h) : canvas->height;
+        memset(canvas->data[i], chroma ? 128 : 0, (size_t)canvas->linesize[i] * height);
+    }
+    return canvas;
+}
+
+// 第 index 个格子在 canvas 里每个平面的起始地址，linesize 还是整张大图的
+static void
+tile_pointers(const SpriteSheet *s, int index, uint8_t *data[4]) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(s->canvas->format);
+    int x = index % s->cols * s->tile_width;
+    int y = index / s->cols * s->tile_height;
+    for (int i = 0; i < 4; i++) {
+        data[i] = NULL;
+        if (s->canvas->data[i] == NULL) {
+            continue;
+        }
+        int chroma = i > 0 && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int plane_x = chroma ? x >> desc->log2_chroma_w : x;
+        int plane_y = chroma ? y >> desc->log2_chroma_h : y;
+        data[i] = s->canvas->data[i] + (ptrdiff_t)plane_y * s->canvas->linesize[i] + plane_x * desc->comp[i].step;
+    }
+}
+
+static void
+sheet_image_path(const SpriteSheet *s, int sheet, char *path, size_t size) {
+    snprintf(path, size, "%s_%d.%s", s->prefix, sheet, export_format_extension(s->format));
+}
+
+// vtt 里引用图片用不带目录的文件名，vtt 和图片在同一个目录
+static const char *
+base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+static void
+write_vtt_time(FILE *f, double t) {
+    int64_t ms = (int64_t)(t * 1000 + 0.5);
+    fprintf(f, "%02lld:%02lld:%02lld.%03lld", (long long)(ms / 3600000), (long long)(ms / 60000 % 60),
+            (long long)(ms / 1000 % 60), (long long)(ms % 1000));
+}
+
+static void
+flush_pending_cue(SpriteSheet *s, double end) {
+    if (!s->has_pending) {
+        return;
+    }
+    if (end <= s->pending_start) {
+        end = s->pending_start + 1;
+    }
+    write_vtt_time(s->vtt, s->pending_start);
+    fprintf(s->vtt, " --> ");
+    write_vtt_time(s->vtt, end);
+    fprintf(s->vtt, "\n%s#xywh=%d,%d,%d,%d\n\n", s->pending_image, s->pending_x, s->pending_y, s->tile_width,
+            s->tile_height);
+    s->has_pending = 0;
+}
+
+// 当前的大图交给导出线程，由它释放
+static int
+submit_canvas(SpriteSheet *s) {
+    char path[SPRITE_PATH_SIZE + 16];
+    sheet_image_path(s, s->sheets + 1, path, sizeof(path));
+    int ret = frame_exporter_submit(s->exporter, s->canvas, path);
+    s->canvas = NULL;
+    s->count = 0;
+    s->sheets += 1;
+    return ret;
+}
+
+int
+sprite_parse_args(SpriteOptions *opts, int argc, const char **argv) {
+    opts->cols = 0;
+    opts->rows = 0;
+    opts->format = EXPORT_JPEG;
+    opts->prefix = "sprite";
+
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--sprite=", 9) == 0) {
+            if (sscanf(argv[i] + 9, "%dx%d", &opts->cols, &opts->rows) != 2 || opts->cols <= 0 || opts->rows <= 0) {
+                opts->cols = 0;
+                opts->rows = 0;
+            }
+        } else if (strncmp(argv[i], "--sprite-format=", 16) == 0) {
+            int format = export_format_from_name(argv[i] + 16);
+            if (format >= 0) {
+                opts->format = format;
+            }
+        } else if (strncmp(argv[i], "--sprite-prefix=", 16) == 0) {
+            opts->prefix = argv[i] + 16;
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    return n;
+}
+
+int
+sprite_sheet_open(SpriteSheet *s, const char *prefix, int cols, int rows, int tile_width, int tile_height,
+                  ExportFormat format, int scale_flags, int verbose) {
+    memset(s, 0, sizeof(*s));
+    s->verbose = verbose;
+    s->cols = cols;
+    s->rows = rows;
+    s->tile_width = tile_width;
+    s->tile_height = tile_height;
+    s->format = format;
+    s->scale_flags = scale_flags;
+    snprintf(s->prefix, sizeof(s->prefix), "%s", prefix);
+
+    char path[SPRITE_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s.vtt", prefix);
+    s->vtt = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    s->json = fopen(path, "w");
+    // 大图不多，一个工作线程就够了
+    s->exporter = frame_exporter_create(format, 1, 2, NULL);
+    if (s->vtt == NULL || s->json == NULL || s->exporter == NULL) {
+        sprite_sheet_close(s, -1);
+        return -1;
+    }
+
+    fprintf(s->vtt, "WEBVTT\n\n");
+    fprintf(s->json, "{\n  \"columns\": %d,\n  \"rows\": %d,\n  \"tile_width\": %d,\n  \"tile_height\": %d,\n", cols,
+            rows, tile_width, tile_height);
+    fprintf(s->json, "  \"tiles\": [");
+    return 0;
+}
+
+int
+sprite_sheet_add(SpriteSheet *s, const AVFrame *frame, double time) {
+    if (s->canvas == NULL) {
+        s->canvas = alloc_canvas(s);
+        if (s->canvas == NULL) {
+            return -1;
+        }
+    }
+
+    struct SwsContext *sws_ctx = scale_cache_get_frame(&s->scale_cache, frame, s->tile_width, s->tile_height,
+                                                       s->canvas->format, s->scale_flags);
+    if (sws_ctx == NULL) {
+        return -1;
+    }
+    // 直接缩放到大图的格子里
+    uint8_t *tile[4];
+    tile_pointers(s, s->count, tile);
+    sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, tile,
+              s->canvas->linesize);
+
+    int x = s->count % s->cols * s->tile_width;
+    int y = s->count / s->cols * s->tile_height;
+    char image[SPRITE_PATH_SIZE + 16];
+    sheet_image_path(s, s->sheets + 1, image, sizeof(image));
+
+    flush_pending_cue(s, time);
+    s->has_pending = 1;
+    s->pending_start = time;
+    s->pending_x = x;
+    s->pending_y = y;
+    snprintf(s->pending_image, sizeof(s->pending_image), "%s", base_name(image));
+
+    fprintf(s->json, "%s\n    {\"time\": %.3f, \"image\": \"%s\", \"x\": %d, \"y\": %d}", s->tiles > 0 ? "," : "",
+            time, base_name(image), x, y);
+    s->tiles += 1;
+
+    s->count += 1;
+    if (s->count == s->cols * s->rows) {
+        return submit_canvas(s);
+    }
+    return 0;
+}
+
+int
+sprite_sheet_close(SpriteSheet *s, double end_time) {
+    int errors = 0;
+    if (s->canvas != NULL && s->count > 0) {
+        errors += submit_canvas(s) < 0;
+    }
+    av_frame_free(&s->canvas);
+    if (s->exporter != NULL) {
+        errors += frame_exporter_finish(s->exporter, s->verbose);
+        s->exporter = NULL;
+    }
+    scale_cache_free(&s->scale_cache);
+
+    if (s->vtt != NULL) {
+        flush_pending_cue(s, end_time);
+        errors += fclose(s->vtt) != 0;
+        s->vtt = NULL;
+    }
+    if (s->json != NULL) {
+        fprintf(s->json, "\n  ],\n  \"sheets\": %d\n}\n", s->sheets);
+        errors += fclose(s->json) != 0;
+        s->json = NULL;
+    }
+    if (s->verbose) {
+        printf("sprite: %lld tiles in %d sheets of %dx%d\n", (long long)s->tiles, s->sheets, s->cols, s->rows);
+    }
+    return errors;
+}
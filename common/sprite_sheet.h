@@ -0,0 +1,77 @@
+#ifndef COMMON_SPRITE_SHEET_H
+#define COMMON_SPRITE_SHEET_H
+
+#include <libavutil/frame.h>
+#include <stdio.h>
+
+#include "convert.h"
+#include "frame_export.h"
+
+#define SPRITE_PATH_SIZE 256
+// 没有用 --thumb 指定大小时每一格的宽度
+#define SPRITE_TILE_WIDTH 160
+
+// 命令行参数 --sprite=COLSxROWS 开启，--sprite-format=ppm|png|jpg 选择图片格式，--sprite-prefix= 指定文件名前缀
+typedef struct SpriteOptions {
+    // 0 表示不生成雪碧图
+    int cols;
+    int rows;
+    ExportFormat format;
+    const char *prefix;
+} SpriteOptions;
+
+// 把很多张缩略图拼成一张大图（雪碧图），配合 WebVTT 做进度条预览
+// 每张大图是 cols x rows 个格子，缩略图直接缩放到大图里对应的格子，不单独分配每一格的内存
+// 大图满了交给导出线程编码写文件，同时写出 <prefix>.vtt 和 <prefix>.json 记录每一格的时间和位置
+typedef struct SpriteSheet {
+    int cols;
+    int rows;
+    int tile_width;
+    int tile_height;
+    int scale_flags;
+    ExportFormat format;
+    char prefix[SPRITE_PATH_SIZE];
+    // 为 0 时关闭时不打印统计
+    int verbose;
+
+    FrameExporter *exporter;
+    ScaleCache scale_cache;
+    // 正在拼的大图，满了以后交给导出线程，再分配一张新的
+    AVFrame *canvas;
+    // canvas 里已经放了几格
+    int count;
+    // 已经写出的大图个数
+    int sheets;
+    int64_t tiles;
+
+    FILE *vtt;
+    FILE *json;
+    // vtt 的结束时间是下一格的开始时间，所以上一格等下一格来了才写
+    int has_pending;
+    double pending_start;
+    int pending_x;
+    int pending_y;
+    char pending_image[SPRITE_PATH_SIZE];
+} SpriteSheet;
+
+// 从 argv 里取出雪碧图相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+sprite_parse_args(SpriteOptions *opts, int argc, const char **argv);
+
+// prefix 是输出文件名的前缀，大图是 <prefix>_1.jpg、<prefix>_2.jpg ...
+// verbose 为 0 时关闭时不打印统计，批量处理时用
+int
+sprite_sheet_open(SpriteSheet *s, const char *prefix, int cols, int rows, int tile_width, int tile_height,
+                  ExportFormat format, int scale_flags, int verbose);
+
+// 把 frame 缩放到下一个格子里，time 是这一帧的时间（秒）
+int
+sprite_sheet_add(SpriteSheet *s, const AVFrame *frame, double time);
+
+// 写出最后一张大图和映射文件，end_time 是最后一格的结束时间，不知道时传小于 0 的值
+// 返回出错的个数
+int
+sprite_sheet_close(SpriteSheet *s, double end_time);
+
+#endif
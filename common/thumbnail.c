@@ -0,0 +1,84 @@
+#include "thumbnail.h"
+
+#include <libswscale/swscale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int
+parse_scaler(const char *value) {
+    if (strcmp(value, "fast") == 0) {
+        return SWS_FAST_BILINEAR;
+    } else if (strcmp(value, "area") == 0) {
+        return SWS_AREA;
+    }
+    return SWS_BILINEAR;
+}
+
+// W 或者 WxH
+static void
+parse_size(ThumbnailOptions *opts, const char *value) {
+    opts->width = 0;
+    opts->height = 0;
+    sscanf(value, "%dx%d", &opts->width, &opts->height);
+    if (opts->width < 0) {
+        opts->width = 0;
+    }
+    if (opts->height < 0) {
+        opts->height = 0;
+    }
+}
+
+int
+thumbnail_parse_args(ThumbnailOptions *opts, int argc, const char **argv) {
+    opts->width = 0;
+    opts->height = 0;
+    opts->flags = SWS_BILINEAR;
+    opts->lowres = 0;
+
+    const char *env = getenv("THUMB_SIZE");
+    if (env != NULL) {
+        parse_size(opts, env);
+    }
+    env = getenv("THUMB_SCALER");
+    if (env != NULL) {
+        opts->flags = parse_scaler(env);
+    }
+
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--thumb=", 8) == 0) {
+            parse_size(opts, argv[i] + 8);
+        } else if (strncmp(argv[i], "--scaler=", 9) == 0) {
+            opts->flags = parse_scaler(argv[i] + 9);
+        } else if (strcmp(argv[i], "--lowres") == 0) {
+            opts->lowres = 1;
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    return n;
+}
+
+void
+thumbnail_size(const ThumbnailOptions *opts, int src_w, int src_h, AVRational sar, int *width, int *height) {
+    // 非方形像素按显示的宽度算，缩略图本身是方形像素
+    int64_t display_w = src_w;
+    if (sar.num > 0 && sar.den > 0) {
+        display_w = (int64_t)src_w * sar.num / sar.den;
+    }
+    int w = opts->width;
+    int h = opts->height;
+    if (w == 0 && h == 0) {
+        *width = src_w;
+        *height = src_h;
+        return;
+    } else if (h == 0) {
+        h = (int)((int64_t)w * src_h / display_w);
+    } else if (w == 0) {
+        w = (int)((int64_t)h * display_w / src_h);
+    }
+    *width = FFMAX(w & ~1, 2);
+    *height = FFMAX(h & ~1, 2);
+}
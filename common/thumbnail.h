@@ -0,0 +1,30 @@
+#ifndef COMMON_THUMBNAIL_H
+#define COMMON_THUMBNAIL_H
+
+#include <libavutil/rational.h>
+
+// 缩略图的大小和缩放算法
+// 缩放和 yuv -> rgb 在同一次 sws_scale 里完成，不先转换出原尺寸的 rgb 图片
+// 可以用环境变量 THUMB_SIZE / THUMB_SCALER
+// 或者命令行参数 --thumb=W[xH] / --scaler=fast|bilinear|area / --lowres 修改，命令行优先
+typedef struct ThumbnailOptions {
+    // 都是 0 表示原尺寸，只给一个时另一个按显示宽高比计算
+    int width;
+    int height;
+    // sws 的缩放算法，fast 是 SWS_FAST_BILINEAR，缩小很多倍时 area 效果更好
+    int flags;
+    // 让解码器直接输出缩小的图像（ffmpeg 的 lowres），解码器支持时才生效
+    // 打开解码器前把 width / height 设置到 DecoderOptions 的 lowres_width / lowres_height
+    int lowres;
+} ThumbnailOptions;
+
+// 用环境变量初始化配置，然后从 argv 里取出缩略图相关的参数
+// 剩下的参数按原来的顺序留在 argv 里，返回剩下的参数个数
+int
+thumbnail_parse_args(ThumbnailOptions *opts, int argc, const char **argv);
+
+// 按原图的宽高和像素宽高比计算缩略图大小，结果是偶数，方便转换成 yuv420p
+void
+thumbnail_size(const ThumbnailOptions *opts, int src_w, int src_h, AVRational sar, int *width, int *height);
+
+#endif
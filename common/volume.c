@@ -0,0 +1,96 @@
+#include "volume.h"
+
+#include <string.h>
+
+#include "pcm.h"
+
+// 音量按平方换算成增益，比线性更接近听感，小音量时调节更细
+static float
+level_gain(int level) {
+    float x = level / 100.0f;
+    return x * x;
+}
+
+void
+volume_init(Volume *v, int sample_rate, int channels, enum AVSampleFormat format) {
+    atomic_init(&v->level, 100);
+    atomic_init(&v->muted, 0);
+    v->gain = 1;
+    v->channels = channels;
+    v->format = format;
+    v->bytes_per_sample = av_get_bytes_per_sample(format);
+    v->ramp_samples = sample_rate * VOLUME_RAMP_MS / 1000;
+    if (v->ramp_samples < 1) {
+        v->ramp_samples = 1;
+    }
+}
+
+int
+volume_change(Volume *v, int delta) {
+    // 只有主线程修改，不需要 compare-and-swap
+    int level = atomic_load(&v->level) + delta;
+    level = level < 0 ? 0 : level > 100 ? 100 : level;
+    atomic_store(&v->level, level);
+    return level;
+}
+
+int
+volume_toggle_mute(Volume *v) {
+    int muted = !atomic_load(&v->muted);
+    atomic_store(&v->muted, muted);
+    return muted;
+}
+
+// 从第 start 个采样开始的 count 个采样乘以 gain，gain 不大于 1，整数格式不会溢出
+static void
+scale_samples(Volume *v, uint8_t *data, int start, int count, float gain) {
+    switch (v->format) {
+    case AV_SAMPLE_FMT_FLT:
+        pcm_apply_gain((float *)data + start, count, gain);
+        break;
+    case AV_SAMPLE_FMT_S16: {
+        int16_t *s = (int16_t *)data + start;
+        for (int i = 0; i < count; i++) {
+            s[i] = (int16_t)(s[i] * gain);
+        }
+    } break;
+    case AV_SAMPLE_FMT_S32: {
+        int32_t *s = (int32_t *)data + start;
+        for (int i = 0; i < count; i++) {
+            s[i] = (int32_t)(s[i] * (double)gain);
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+void
+volume_apply(Volume *v, uint8_t *data, int len) {
+    float target = atomic_load(&v->muted) ? 0 : level_gain(atomic_load(&v->level));
+    int frames = len / (v->channels * v->bytes_per_sample);
+    int i = 0;
+    // 渐变：每个采样点把增益向目标移动一步，同一个点的各个声道用同一个增益
+    float step = 1.0f / v->ramp_samples;
+    for (; i < frames && v->gain != target; i++) {
+        if (v->gain < target) {
+            v->gain = v->gain + step < target ? v->gain + step : target;
+        } else {
+            v->gain = v->gain - step > target ? v->gain - step : target;
+        }
+        scale_samples(v, data, i * v->channels, v->channels, v->gain);
+    }
+    if (i == frames || v->gain == 1) {
+        // 默认音量不做任何处理
+        return;
+    }
+    int offset = i * v->channels;
+    int count = (frames - i) * v->channels;
+    if (v->gain == 0) {
+        // 这几种格式的静音都是 0
+        memset(data + offset * v->bytes_per_sample, 0, count * v->bytes_per_sample);
+    } else {
+        // 剩下的部分增益不变，float 用 SIMD 一次乘一整块
+        scale_samples(v, data, offset, count, v->gain);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef COMMON_VOLUME_H
+#define COMMON_VOLUME_H
+
+#include <libavutil/samplefmt.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// 音量从当前值变到目标值用的时间，全程静音到最大音量也只用这么久，短到听不出渐变，又不会因为突变产生咔哒声
+#define VOLUME_RAMP_MS 10
+// 每次按键调整的音量
+#define VOLUME_STEP 5
+
+// 软件音量和静音
+// 主线程（处理按键）只改目标音量，音频回调在设备缓冲区上原地乘增益，不拷贝也不分配内存，不增加延迟
+// 调节后下一次回调就生效，不用等音频缓冲区里已经转换好的数据播完
+typedef struct Volume {
+    // 0-100，主线程写，回调读
+    atomic_int level;
+    atomic_int muted;
+    // 回调里当前实际用的增益，只在回调里访问
+    float gain;
+    int channels;
+    int bytes_per_sample;
+    enum AVSampleFormat format;
+    // 增益从 0 变到 1 经过的采样数（每个声道）
+    int ramp_samples;
+} Volume;
+
+// format 是设备的采样格式，支持交错的 flt / s16 / s32，音量默认 100
+void
+volume_init(Volume *v, int sample_rate, int channels, enum AVSampleFormat format);
+
+// 音量加上 delta，限制在 0-100，返回新的音量
+int
+volume_change(Volume *v, int delta);
+
+// 切换静音，返回切换后是否静音
+int
+volume_toggle_mute(Volume *v);
+
+// 给音频回调用，按当前音量原地修改 len 字节的数据
+void
+volume_apply(Volume *v, uint8_t *data, int len);
+
+#endif
@@ -0,0 +1,192 @@
+#include "wav_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// 缓冲区大小，攒够了再调用一次 writev
+#define WAV_BUFFER_SIZE (1024 * 1024)
+
+// 文件头固定 80 字节：RIFF 头 12 + JUNK 36 + fmt 24 + data 头 8
+// JUNK 块是给 ds64 块预留的位置，普通 wav 的读取程序会跳过它
+#define WAV_HEADER_SIZE 80
+#define WAV_JUNK_OFFSET 12
+#define WAV_DATA_SIZE_OFFSET 76
+
+static void
+put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void
+put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+static void
+put_le64(uint8_t *p, uint64_t v) {
+    put_le32(p, v);
+    put_le32(p + 4, v >> 32);
+}
+
+static int
+pwrite_all(int fd, const void *data, size_t size, off_t offset) {
+    const uint8_t *p = data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// 先写缓冲区里的数据，再接着写 data，合并成一次 writev 系统调用
+static int
+writev_all(int fd, const uint8_t *buf, size_t buf_len, const uint8_t *data, size_t size) {
+    struct iovec iov[2] = {
+        {(void *)buf, buf_len},
+        {(void *)data, size},
+    };
+    int index = buf_len > 0 ? 0 : 1;
+    while (index < 2) {
+        ssize_t n = writev(fd, iov + index, 2 - index);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // 处理只写了一部分的情况
+        while (index < 2 && (size_t)n >= iov[index].iov_len) {
+            n -= iov[index].iov_len;
+            index += 1;
+        }
+        if (index < 2) {
+            iov[index].iov_base = (uint8_t *)iov[index].iov_base + n;
+            iov[index].iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int
+wav_writer_open(WavWriter *w, const char *path, int sample_rate, int channels, int bits_per_sample, int is_float) {
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        return -1;
+    }
+    w->buf = malloc(WAV_BUFFER_SIZE);
+    if (w->buf == NULL) {
+        close(w->fd);
+        return -1;
+    }
+    w->buf_cap = WAV_BUFFER_SIZE;
+    w->block_align = bits_per_sample * channels / 8;
+
+    // 大小先填 0，关闭的时候再回填
+    uint8_t header[WAV_HEADER_SIZE] = {0};
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + WAV_JUNK_OFFSET, "JUNK", 4);
+    put_le32(header + 16, 28);
+    // chunk1
+    memcpy(header + 48, "fmt ", 4);
+    put_le32(header + 52, 16);
+    // 1 是整数 pcm，3 是浮点
+    put_le16(header + 56, is_float ? 3 : 1);
+    put_le16(header + 58, channels);
+    put_le32(header + 60, sample_rate);
+    put_le32(header + 64, sample_rate * w->block_align);
+    put_le16(header + 68, w->block_align);
+    put_le16(header + 70, bits_per_sample);
+    // chunk2
+    memcpy(header + 72, "data", 4);
+
+    if (pwrite_all(w->fd, header, sizeof(header), 0) < 0 || lseek(w->fd, WAV_HEADER_SIZE, SEEK_SET) < 0) {
+        free(w->buf);
+        close(w->fd);
+        return -1;
+    }
+    return 0;
+}
+
+int
+wav_writer_write(WavWriter *w, const void *data, size_t size) {
+    if (w->buf_len + size <= w->buf_cap) {
+        memcpy(w->buf + w->buf_len, data, size);
+        w->buf_len += size;
+        w->data_size += size;
+        return 0;
+    }
+
+    // 缓冲区放不下，把缓冲区和新数据一起写出去，新数据不用再拷贝一次
+    int ret = writev_all(w->fd, w->buf, w->buf_len, data, size);
+    if (ret < 0) {
+        // 缓冲区里的数据也没写出去，文件头里的大小只算写成功的部分
+        w->data_size -= w->buf_len;
+    } else {
+        w->data_size += size;
+    }
+    w->buf_len = 0;
+    return ret;
+}
+
+int
+wav_writer_close(WavWriter *w) {
+    int ret = 0;
+    if (w->buf_len > 0 && writev_all(w->fd, w->buf, w->buf_len, NULL, 0) < 0) {
+        w->data_size -= w->buf_len;
+        ret = -1;
+    }
+
+    // data 块的大小必须是偶数，奇数时补一个字节
+    uint64_t padding = w->data_size & 1;
+    if (padding && writev_all(w->fd, (const uint8_t *)"", 1, NULL, 0) < 0) {
+        ret = -1;
+    }
+    uint64_t riff_size = WAV_HEADER_SIZE - 8 + w->data_size + padding;
+
+    uint8_t field[4];
+    if (riff_size <= UINT32_MAX) {
+        put_le32(field, riff_size);
+        ret |= pwrite_all(w->fd, field, 4, 4);
+        put_le32(field, w->data_size);
+        ret |= pwrite_all(w->fd, field, 4, WAV_DATA_SIZE_OFFSET);
+    } else {
+        // 超过 4GB，32 位的大小字段放不下，改成 RF64，真正的大小写在 ds64 块里
+        uint8_t ds64[36] = {0};
+        memcpy(ds64, "ds64", 4);
+        put_le32(ds64 + 4, 28);
+        put_le64(ds64 + 8, riff_size);
+        put_le64(ds64 + 16, w->data_size);
+        put_le64(ds64 + 24, w->block_align > 0 ? w->data_size / w->block_align : 0);
+        ret |= pwrite_all(w->fd, ds64, sizeof(ds64), WAV_JUNK_OFFSET);
+
+        uint8_t riff[8];
+        memcpy(riff, "RF64", 4);
+        put_le32(riff + 4, UINT32_MAX);
+        ret |= pwrite_all(w->fd, riff, sizeof(riff), 0);
+        put_le32(field, UINT32_MAX);
+        ret |= pwrite_all(w->fd, field, 4, WAV_DATA_SIZE_OFFSET);
+    }
+
+    free(w->buf);
+    w->buf = NULL;
+    if (close(w->fd) < 0) {
+        ret = -1;
+    }
+    return ret < 0 ? -1 : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef COMMON_WAV_WRITER_H
+#define COMMON_WAV_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 边解码边写 wav 文件，内存占用固定，和文件长短无关
+// 打开时先写好文件头，数据攒到缓冲区里批量写入，关闭时再回填 RIFF 和 data 的大小
+// 数据超过 4GB 时关闭时把文件改写成 RF64 格式
+typedef struct WavWriter {
+    int fd;
+    // 已经写入的音频数据字节数
+    uint64_t data_size;
+    int block_align;
+    uint8_t *buf;
+    size_t buf_len;
+    size_t buf_cap;
+} WavWriter;
+
+// is_float 为 1 时数据是 32 位浮点，否则是整数 pcm
+int
+wav_writer_open(WavWriter *w, const char *path, int sample_rate, int channels, int bits_per_sample, int is_float);
+
+// 追加交错存放的音频数据，出错返回 -1，关闭时文件头只记录写成功的部分
+int
+wav_writer_write(WavWriter *w, const void *data, size_t size);
+
+// 写完剩余数据，回填文件头，关闭文件
+int
+wav_writer_close(WavWriter *w);
+
+#endif
@@ -0,0 +1,315 @@
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <ftw.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../common/extract.h"
+
+// 批量抽帧，按 1/1s1f.c 的方式处理清单里或者目录下的每一个文件
+// 多个文件同时处理，一个文件出错只记录下来，不影响其他文件
+// 每个文件的输出放在 <输出目录>/<序号>_<文件名>/ 里，失败的文件列在 <输出目录>/failed.txt，方便重跑
+//
+// 用法: batch <清单文件|目录> <输出目录> [decode|seek|key|scene] [interval seconds] [scene threshold 0-1] [--jobs=N]
+// 清单文件每行一个路径，空行和 # 开头的行忽略；目录会递归扫描
+// 1/1s1f.c 的参数（--thumb、--sprite、--io 等）都可以用
+
+typedef struct FileList {
+    char **paths;
+    int count;
+    int capacity;
+} FileList;
+
+typedef struct Batch {
+    const ExtractOptions *opts;
+    const char *output_dir;
+    FileList *files;
+    int jobs;
+    int cpus;
+
+    // 下一个要处理的文件，下面的统计都在 lock 保护下修改
+    pthread_mutex_t lock;
+    int next;
+    int done;
+    int failed;
+    FILE *failed_list;
+    int64_t frames_saved;
+    int64_t frames_decoded;
+    int64_t bytes_read;
+    double duration;
+} Batch;
+
+static int
+file_list_add(FileList *list, const char *path) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 256;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (paths == NULL) {
+            return -1;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        return -1;
+    }
+    list->count += 1;
+    return 0;
+}
+
+static void
+file_list_free(FileList *list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+}
+
+static int
+has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s);
+    size_t m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int
+load_manifest(const char *path, FileList *list) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        if (file_list_add(list, line) < 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// nftw 的回调没有用户参数，扫描目录时用这个全局变量
+static FileList *walk_list;
+
+static int
+walk_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    const char *name = path + ftw->base;
+    // 跳过隐藏文件和 seek_index、--stream-cache 生成的旁路文件
+    if (type != FTW_F || name[0] == '.' || has_suffix(name, ".idx") || has_suffix(name, ".streams")) {
+        return 0;
+    }
+    return file_list_add(walk_list, path) < 0 ? -1 : 0;
+}
+
+static int
+compare_path(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int
+load_dir(const char *path, FileList *list) {
+    walk_list = list;
+    int ret = nftw(path, walk_entry, 64, FTW_PHYS);
+    walk_list = NULL;
+    // 目录项的顺序不固定，排序后每次运行的序号都一样
+    if (ret == 0 && list->count > 0) {
+        qsort(list->paths, list->count, sizeof(char *), compare_path);
+    }
+    return ret;
+}
+
+// 一个文件用几个解码线程
+// 文件多的时候每个文件一个线程，文件之间并行效率最高，没有线程同步的开销
+// 剩下的文件比工作线程少时，把空出来的核分给剩下的文件，避免最后只有一两个单线程的文件在跑
+static int
+decoder_threads(const Batch *b, int index) {
+    int remaining = b->files->count - index;
+    int parallel = remaining < b->jobs ? remaining : b->jobs;
+    int threads = b->cpus / parallel;
+    return threads > 0 ? threads : 1;
+}
+
+static void
+process_file(Batch *b, int index) {
+    const char *filename = b->files->paths[index];
+    ExtractOptions opts = *b->opts;
+    if (opts.decoder.thread_count <= 0) {
+        opts.decoder.thread_count = decoder_threads(b, index);
+    }
+
+    const char *name = strrchr(filename, '/');
+    name = name != NULL ? name + 1 : filename;
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s/%05d_%s", b->output_dir, index + 1, name);
+    char prefix[1040];
+    snprintf(prefix, sizeof(prefix), "%s/", dir);
+    opts.output_prefix = prefix;
+
+    int64_t start = av_gettime_relative();
+    ExtractResult result = {0};
+    int ret = -1;
+    if (mkdir(dir, 0755) == 0 || errno == EEXIST) {
+        ret = extract_frames(filename, &opts, &result);
+    } else {
+        printf("Could not create %s\n", dir);
+    }
+    double ms = (av_gettime_relative() - start) / 1000.0;
+
+    pthread_mutex_lock(&b->lock);
+    b->done += 1;
+    if (ret < 0) {
+        b->failed += 1;
+        if (b->failed_list != NULL) {
+            fprintf(b->failed_list, "%s\n", filename);
+            fflush(b->failed_list);
+        }
+        printf("[%d/%d] failed %s, %.0f ms\n", b->done, b->files->count, filename, ms);
+    } else {
+        printf("[%d/%d] %s: %d images, %d frames decoded, %d threads, %.0f ms\n", b->done, b->files->count, filename,
+               result.frames_saved, result.frames_decoded, opts.decoder.thread_count, ms);
+    }
+    // 失败的文件也把已经读了和解码了的算进去，统计的是机器实际做了的工作
+    b->frames_saved += result.frames_saved;
+    b->frames_decoded += result.frames_decoded;
+    b->bytes_read += result.bytes_read;
+    b->duration += ret < 0 ? 0 : result.duration;
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *
+worker(void *arg) {
+    Batch *b = arg;
+    while (1) {
+        pthread_mutex_lock(&b->lock);
+        int index = b->next;
+        b->next += 1;
+        pthread_mutex_unlock(&b->lock);
+        if (index >= b->files->count) {
+            break;
+        }
+        process_file(b, index);
+    }
+    return NULL;
+}
+
+int
+main(int argc, char const *argv[]) {
+    ExtractOptions opts;
+    argc = extract_parse_args(&opts, argc, argv);
+    int jobs = 0;
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            jobs = atoi(argv[i] + 7);
+        } else {
+            argv[n] = argv[i];
+            n += 1;
+        }
+    }
+    argc = n;
+    if (argc < 3) {
+        printf("Usage: %s <manifest|dir> <output dir> [decode|seek|key|scene] [interval seconds] [scene threshold 0-1] "
+               "[--jobs=N]\n",
+               argv[0]);
+        return -1;
+    }
+    const char *input = argv[1];
+    const char *output_dir = argv[2];
+    if (argc > 3) {
+        int mode = extract_mode_from_name(argv[3]);
+        if (mode < 0) {
+            printf("Unknown mode %s\n", argv[3]);
+            return -1;
+        }
+        opts.mode = mode;
+    }
+    if (argc > 4) {
+        opts.interval = atoi(argv[4]);
+    }
+    if (argc > 5) {
+        opts.scene_threshold = atof(argv[5]);
+    }
+    // 每个文件的详细信息太多了，只打印每个文件一行结果和出错信息
+    opts.verbose = 0;
+    av_log_set_level(AV_LOG_ERROR);
+
+    FileList files = {0};
+    struct stat st;
+    if (stat(input, &st) < 0) {
+        printf("Could not open %s\n", input);
+        return -1;
+    }
+    int ret = S_ISDIR(st.st_mode) ? load_dir(input, &files) : load_manifest(input, &files);
+    if (ret < 0) {
+        printf("Could not read file list from %s\n", input);
+        file_list_free(&files);
+        return -1;
+    }
+    if (mkdir(output_dir, 0755) < 0 && errno != EEXIST) {
+        printf("Could not create %s\n", output_dir);
+        file_list_free(&files);
+        return -1;
+    }
+
+    Batch b = {
+        .opts = &opts,
+        .output_dir = output_dir,
+        .files = &files,
+        .cpus = av_cpu_count(),
+    };
+    // 默认每个核一个文件
+    b.jobs = jobs > 0 ? jobs : b.cpus;
+    if (b.jobs > files.count) {
+        b.jobs = files.count > 0 ? files.count : 1;
+    }
+    pthread_mutex_init(&b.lock, NULL);
+    char failed_path[1024];
+    snprintf(failed_path, sizeof(failed_path), "%s/failed.txt", output_dir);
+    b.failed_list = fopen(failed_path, "w");
+    printf("batch: %d files, %d jobs, %d cpus\n", files.count, b.jobs, b.cpus);
+
+    int64_t start = av_gettime_relative();
+    pthread_t *threads = calloc(b.jobs, sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; threads != NULL && i < b.jobs; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &b) != 0) {
+            break;
+        }
+        started += 1;
+    }
+    if (started == 0) {
+        // 开不了线程就在主线程里一个一个处理
+        worker(&b);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    if (seconds <= 0) {
+        seconds = 1e-6;
+    }
+    printf("batch: %d files, %d failed, %.2fs\n", b.done, b.failed, seconds);
+    printf("batch: %.2f files/s, %.1f decoded fps, %lld images, %.1f MB/s read, %.1fx realtime\n", b.done / seconds,
+           b.frames_decoded / seconds, (long long)b.frames_saved, b.bytes_read / seconds / (1024 * 1024),
+           b.duration / seconds);
+
+    if (b.failed_list != NULL) {
+        fclose(b.failed_list);
+    }
+    pthread_mutex_destroy(&b.lock);
+    file_list_free(&files);
+    return b.failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,53 @@
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+
+#include "../common/seek_index.h"
+
+// 扫描视频文件，为每个文件生成关键帧索引 <文件名>.idx
+// 1/1s1f.c 和 4/2.c 发现索引存在时直接用它找关键帧
+//
+// 用法: seek_index <file> [file ...]
+
+int
+main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <file> [file ...]\n", argv[0]);
+        return -1;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *filename = argv[i];
+        int64_t start = av_gettime_relative();
+        AVFormatContext *fmt_ctx = NULL;
+        int ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
+        if (ret < 0) {
+            printf("Could not open file %s\n", filename);
+            failed += 1;
+            continue;
+        }
+        ret = avformat_find_stream_info(fmt_ctx, NULL);
+        if (ret < 0 || seek_index_build(fmt_ctx, filename) < 0) {
+            printf("Could not index %s\n", filename);
+            avformat_close_input(&fmt_ctx);
+            failed += 1;
+            continue;
+        }
+
+        SeekIndex *index = seek_index_open(filename);
+        if (index == NULL) {
+            printf("Could not load index of %s\n", filename);
+            avformat_close_input(&fmt_ctx);
+            failed += 1;
+            continue;
+        }
+        printf("%s: %.1f ms, %zu bytes\n", filename, (av_gettime_relative() - start) / 1000.0, index->size);
+        for (int64_t s = 0; s < index->header->nb_streams; s++) {
+            printf("  stream %lld: %lld packets, %lld keyframes\n", (long long)s,
+                   (long long)index->streams[s].packet_count, (long long)index->streams[s].key_count);
+        }
+        seek_index_close(&index);
+        avformat_close_input(&fmt_ctx);
+    }
+    return failed > 0 ? -1 : 0;
+}